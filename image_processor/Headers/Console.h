@@ -8,6 +8,7 @@ struct ParsedCommands {
     const char* input_path;
     const char* output_path;
     std::vector<std::pair<std::string, std::vector<std::string_view>>> filters;
+    size_t threads_count = 0;  // all hardware threads
 };
 
 class Console {
@@ -1,14 +1,51 @@
 #pragma once
 
 #include "Image.h"
+#include "ThreadPool.h"
 
-void Crop(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void EdgeDetection(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void GaussianBlur(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void Grayscale(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void Negative(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void Noise(Image& filtered, const Image& image, std::vector<std::string_view> filter);
-void Sharpening(Image& filtered, const Image& image, std::vector<std::string_view> filter);
+void Crop(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+          ThreadPool& pool);
+void EdgeDetection(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+                   ThreadPool& pool);
+void GaussianBlur(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+                  ThreadPool& pool);
+void Grayscale(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+               ThreadPool& pool);
+void Negative(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+              ThreadPool& pool);
+void Noise(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+           ThreadPool& pool);
+void Sharpening(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> filter,
+                ThreadPool& pool);
 
-void ApplyFilter(const Image& image, std::pair<std::string, std::vector<std::string_view>> filter);
-void FilterChain(Image& image, std::vector<std::pair<std::string, std::vector<std::string_view>>> filters);
\ No newline at end of file
+// Per-pixel filters are also given as kernels computing row y of the result from row y of the source, so that
+// several of them can run in one pass. Rows are indexed by Channel and may be the same for the source and the result.
+using PixelKernel = std::function<void(size_t y, const double* const source[], double* const row[], size_t width)>;
+
+PixelKernel GrayscaleKernel(const ComponentImage& image, std::vector<std::string_view> filter);
+PixelKernel NegativeKernel(const ComponentImage& image, std::vector<std::string_view> filter);
+PixelKernel NoiseKernel(const ComponentImage& image, std::vector<std::string_view> filter);
+
+void ApplyPixelKernels(ComponentImage& filtered, const ComponentImage& image, const std::vector<PixelKernel>& kernels,
+                       ThreadPool& pool);
+
+// The kernel of a per-pixel filter for the image, and an empty function for the other filters
+PixelKernel MakePixelKernel(const ComponentImage& image,
+                            const std::pair<std::string, std::vector<std::string_view>>& filter);
+
+// Rows on each side of a row of the result which the filter reads: the filter gives the same rows on a band of the
+// image as on the whole image, as long as the band extends this far beyond them or up to the edge of the image. Crop
+// moves the rows instead and reads none around them. Throws FilterArgumentException for invalid arguments, so that
+// filters can be checked before they run.
+size_t FilterContext(const std::pair<std::string, std::vector<std::string_view>>& filter);
+
+void ApplyFilter(ComponentImage& filtered, const ComponentImage& image,
+                 std::pair<std::string, std::vector<std::string_view>> filter, ThreadPool& pool);
+// A run of per-pixel filters in one pass of their kernels. A lone filter runs on its own, without kernels.
+void ApplyPixelFilters(ComponentImage& filtered, const ComponentImage& image,
+                       const std::vector<std::pair<std::string, std::vector<std::string_view>>>& filters,
+                       ThreadPool& pool);
+// Runs of per-pixel filters are fused into one pass. Filters run on threads_count threads (all hardware threads
+// for 0), which does not change the result. Components are carried from filter to filter unrounded.
+void FilterChain(ComponentImage& image, std::vector<std::pair<std::string, std::vector<std::string_view>>> filters,
+                 size_t threads_count = 0);
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+// Samples of the Gaussian of sigma from -3 sigma to 3 sigma, the kernel of the blur along each axis
+std::vector<double> GaussianCoefficients(double sigma);
+
+// Blurs with the kernel along the columns and then along the rows, clamping coordinates to the image. The cost per
+// pixel grows with the size of the kernel.
+void BlurExact(ComponentImage& filtered, const ComponentImage& image, const std::vector<double>& coefficients,
+               ThreadPool& pool);
+
+// Repeated box blurs of odd widths approximating the Gaussian blur, computed with running sums in fixed point, so
+// that the cost per pixel does not depend on sigma
+struct BoxCascade {
+    std::vector<size_t> widths;
+    double scale = 1;  // sum of the Gaussian coefficients, which the boxes would otherwise make brighter
+    double max_error = 0;  // bound of the difference from BlurExact, in levels of a channel
+};
+
+BoxCascade MakeBoxCascade(double sigma, size_t boxes_count);
+void BlurBoxes(ComponentImage& filtered, const ComponentImage& image, const BoxCascade& cascade, ThreadPool& pool);
@@ -2,9 +2,13 @@
 
 #include "Exceptions.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <new>
 
 struct Color {
     double r, g, b;
@@ -16,24 +20,160 @@ struct Color {
     Color& operator+=(const Color& color);
 };
 
-class Image {
+enum Channel { kRed, kGreen, kBlue, kChannelsCount };
+
+template <class T>
+struct AlignedAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t kAlignment{64};
+
+    AlignedAllocator() = default;
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U>&) {  // NOLINT
+    }
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), kAlignment));
+    }
+    void deallocate(T* pointer, size_t) {
+        ::operator delete(pointer, kAlignment);
+    }
+    template <class U>
+    bool operator==(const AlignedAllocator<U>&) const {
+        return true;
+    }
+};
+
+// Files store components as bytes, and filters compute with components as doubles from 0 to 1. Reading divides by
+// 255, and writing multiplies by 255, clamps and rounds down, as exporting always did.
+inline double ToComponent(uint8_t value) {
+    return static_cast<double>(value) / 255.0;  // NOLINT
+}
+
+inline uint8_t ToByte(double component) {
+    const double max = 255.0;
+    return static_cast<uint8_t>(std::min(max, std::max(0.0, component * max)));
+}
+
+// Between filters, components are kept as 16-bit levels, level v standing for v / 65535, so that byte b is level
+// 257 b exactly. A component is stored as the level of its byte plus its fraction of a byte in 256ths, rounded up.
+// Dividing the level by 257 gives ToByte of the component, so a filter writes the same bytes as it would from its
+// doubles. Components which are whole bytes are kept exactly, and ones slightly above or below them stay above or
+// below, which keeps the rounding of a chain of filters closest to that of doubles.
+const uint16_t kLevelsPerByte = 257;
+const double kFractionSteps = 256;
+
+inline double FromLevel(uint16_t level) {
+    return static_cast<double>(level) / 65535.0;  // NOLINT
+}
+
+inline uint16_t ToLevel(double component) {
+    const double max = 255.0;
+    const double scaled = std::min(max, std::max(0.0, component * max));
+    const auto byte = static_cast<uint16_t>(scaled);
+    return byte * kLevelsPerByte + static_cast<uint16_t>(std::ceil((scaled - byte) * kFractionSteps));
+}
+
+// FromLevel and ToLevel of every value of a row, with SSE2 vectors where available
+void ToComponents(const uint16_t* levels, size_t width, double* components);
+void ToLevels(const double* components, size_t width, uint16_t* levels);
+// Levels of bytes and bytes of levels
+void BytesToLevels(const uint8_t* bytes, size_t width, uint16_t* levels);
+void LevelsToBytes(const uint16_t* levels, size_t width, uint8_t* bytes);
+
+// Conversions between rows of BMP pixels (blue, green, red bytes) and rows of the three planes. Use SSSE3 shuffles
+// where the processor supports them.
+void SplitBgr(const uint8_t* bgr, size_t width, uint8_t* red, uint8_t* green, uint8_t* blue);
+void MergeBgr(const uint8_t* red, const uint8_t* green, const uint8_t* blue, size_t width, uint8_t* bgr);
+
+// Pixels are kept in three planes of values (red, green, blue). Rows of a plane start at multiples of kRowAlignment
+// bytes, so filters can run over whole rows. Rows are numbered from the bottom, as in BMP.
+//
+// An Image holds bytes, 3 per pixel, exactly as 24-bit BMP files do. Filters pass a ComponentImage of levels from one
+// to the next instead, 6 bytes per pixel, and compute with doubles a few rows at a time.
+template <class Value>
+class BasicImage {
 public:
-    Image(size_t width, size_t height);  // с size_t перестает адекватно работать поиск ближайшей клетки
+    static constexpr size_t kRowAlignment = 64;
+    static constexpr size_t kIoBufferSize = 1 << 20;  // Read and Export transfer as many whole rows at once
+
+    BasicImage(size_t width, size_t height);  // с size_t перестает адекватно работать поиск ближайшей клетки
 
+    // Coordinates outside of the image are moved to the nearest pixel
     Color GetColor(size_t x, size_t y) const;
     void SetColor(const Color& color, size_t x, size_t y);
-    void SetWidth(size_t width);
-    void SetHeight(size_t height);
+
+    Value* GetRow(Channel channel, size_t y);
+    const Value* GetRow(Channel channel, size_t y) const;
 
     void Export(std::ofstream& os) const;
     void Read(std::ifstream& of);
 
     size_t GetWidth() const;
     size_t GetHeight() const;
-    Image Crop(size_t width, size_t height) const;
+    // Changes the size, reusing the memory of the pixels as far as it suffices. The pixels are left undefined.
+    void Resize(size_t width, size_t height);
+    BasicImage Crop(size_t width, size_t height) const;
 
 private:
     size_t m_width_;
     size_t m_height_;
-    std::vector<std::vector<Color>> m_colors_;
-};
\ No newline at end of file
+    size_t m_stride_;  // values between the beginnings of rows
+    std::vector<Value, AlignedAllocator<Value>> m_pixels_;
+};
+
+using Image = BasicImage<uint8_t>;
+using ComponentImage = BasicImage<uint16_t>;
+
+// Reads the pixels of a 24-bit BMP file as many rows at a time as asked, in the order they are stored, from the bottom
+// up, so that the whole image never has to be in memory
+class BmpReader {
+public:
+    explicit BmpReader(std::ifstream& in);  // reads the headers
+
+    bool IsBmp() const;
+    size_t GetWidth() const;  // 0 unless the file is a BMP image
+    size_t GetHeight() const;
+
+    // Reads the next count rows of the file into rows [first, first + count) of the image
+    void ReadRows(Image& image, size_t first, size_t count);
+    void ReadRows(ComponentImage& image, size_t first, size_t count);
+    // Closes the file once all rows are read
+    void Finish();
+
+private:
+    // Reads count rows a buffer at a time and passes each row of pixels with its number to split_row
+    template <class SplitRow>
+    void ReadBlocks(size_t count, SplitRow split_row);
+
+    std::ifstream& m_in_;
+    bool m_bmp_ = false;
+    size_t m_width_ = 0;
+    size_t m_height_ = 0;
+    size_t m_row_size_ = 0;  // bytes of a row in the file, padding included
+    std::vector<uint8_t> m_buffer_;
+    std::vector<uint8_t> m_planes_;  // the three planes of a row of bytes on its way to levels
+};
+
+// Writes a 24-bit BMP file of the given size as many rows at a time as given, from the bottom up
+class BmpWriter {
+public:
+    BmpWriter(std::ofstream& out, size_t width, size_t height);  // writes the headers
+
+    // Writes rows [first, first + count) of the image as the next rows of the file
+    void WriteRows(const Image& image, size_t first, size_t count);
+    void WriteRows(const ComponentImage& image, size_t first, size_t count);
+    // Closes the file once all rows are written and reports whether writing succeeded
+    void Finish();
+
+private:
+    // Writes count rows a buffer at a time, merge_row filling the pixels of each row of the buffer given its number
+    template <class MergeRow>
+    void WriteBlocks(size_t count, MergeRow merge_row);
+
+    std::ofstream& m_out_;
+    size_t m_width_;
+    size_t m_row_size_;
+    std::vector<uint8_t> m_buffer_;  // padding bytes stay zero
+    std::vector<uint8_t> m_planes_;  // the three planes of a row of levels rounded to bytes
+};
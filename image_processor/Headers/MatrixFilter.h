@@ -1,3 +1,17 @@
 #include "Image.h"
+#include "ThreadPool.h"
 
-Image MatrixFilter(const Image& image, const std::vector<std::vector<double>>& matrix, double thresh = 4);
\ No newline at end of file
+// Applies the 3x3 matrix to three consecutive rows of values, clamping columns to the row. rows[i] is multiplied by
+// matrix[i], as rows y - 1, y and y + 1 around row y. The interior columns are computed with AVX2 or SSE2 vectors of
+// doubles, adding the products in the same order as ConvolveRowScalar, so both give exactly the same sums.
+void ConvolveRow(const double* const rows[3], const std::vector<std::vector<double>>& matrix, size_t width,
+                 double* sums);
+void ConvolveRowScalar(const double* const rows[3], const std::vector<std::vector<double>>& matrix, size_t width,
+                       double* sums);
+
+// Stores 1 for the sums above the threshold and 0 for the rest, in place if row is sums
+void ThresholdRow(const double* sums, size_t width, double thresh, double* row);
+
+// A threshold of 4 clamps every channel instead of thresholding, as it always did
+void MatrixFilter(ComponentImage& filtered, const ComponentImage& image, const std::vector<std::vector<double>>& matrix,
+                  ThreadPool& pool, double thresh = 4);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Filters.h"
+
+// Filters the image of a BMP file into another BMP file a band of rows at a time. Rows are read from the bottom up,
+// every filter keeps only the rows of its source which the rows of its result still to come need, and rows of the
+// result are written as soon as the last filter gives them. The result is the same as that of FilterChain on the whole
+// image, noise aside, while the memory taken grows with the width of the image and the heights of the kernels rather
+// than with the height of the image. Filters run on threads_count threads (all hardware threads for 0).
+void StreamFilterChain(std::ifstream& in, std::ofstream& out,
+                       const std::vector<std::pair<std::string, std::vector<std::string_view>>>& filters,
+                       size_t threads_count = 0);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running the ranges of ParallelFor. Every thread, the caller included, has its own queue of
+// ranges. A thread takes ranges from the front of its queue, and once it is empty, steals from the back of the
+// others, so that threads which got cheaper ranges help the rest.
+class ThreadPool {
+public:
+    // threads_count includes the calling thread, 0 means all hardware threads
+    explicit ThreadPool(size_t threads_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t ThreadsCount() const;
+
+    // Calls function(begin, end) for consecutive ranges of at most grain items covering [0, count) and returns when
+    // all of them are done. The first exception thrown by the function is rethrown here. Not reentrant.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& function);
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    bool RunRange(size_t thread);
+    void Work(size_t thread);
+
+    std::vector<std::unique_ptr<Queue>> m_queues_;
+    std::vector<std::thread> m_threads_;
+
+    std::mutex m_mutex_;
+    std::condition_variable m_work_ready_;
+    std::condition_variable m_work_done_;
+    size_t m_generation_ = 0;  // incremented by every ParallelFor, wakes the workers
+    bool m_stop_ = false;
+
+    const std::function<void(size_t, size_t)>* m_function_ = nullptr;
+    std::atomic<size_t> m_remaining_ = 0;  // ranges not finished yet
+    std::exception_ptr m_error_;
+};
+
+// Splits rows [0, height) of an image of the given width into bands of about kBandPixels pixels and runs
+// function(begin, end) on them in parallel. Filters write only the rows of their band and read the source image, plus
+// the rows around the band their neighbourhood needs, so bands need no synchronization and the result does not
+// depend on the number of threads.
+inline constexpr size_t kBandPixels = 1 << 16;
+
+inline void ForEachBand(ThreadPool& pool, size_t width, size_t height,
+                        const std::function<void(size_t, size_t)>& function) {
+    pool.ParallelFor(height, kBandPixels / std::max<size_t>(1, width), function);
+}
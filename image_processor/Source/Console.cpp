@@ -1,7 +1,17 @@
 #include "../Headers/Console.h"
 #include "../Headers/Exceptions.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const size_t kMaxThreadsPerHardwareThread = 4;
+
+}  // namespace
 
 void PrintHelp() {
     std::cout << "Image processor.\nAccepted input format: \"input_path output_path filter1_name "
@@ -10,10 +20,14 @@ void PrintHelp() {
                  "starting from upper-left corner\n-gs - converts image into grayscale\n"
                  "-neg - converts colors into their respective opposites\n"
                  "-sharp - sharpens the image\n-edge threshold - finds boundaries of objects in the image, "
-                 "threshold is a double value\n-blur sigma - applies Gaussian blur "
-                 "with standard deviation sigma, sigma is a double value.\n-noise "
+                 "threshold is a double value\n-blur sigma [tolerance] - applies Gaussian blur "
+                 "with standard deviation sigma, sigma is a double value. Given a tolerance, a double number of "
+                 "levels of a channel, large sigmas are blurred much faster by repeated box blurs as long as they "
+                 "differ from the exact blur by no more than the tolerance.\n-noise "
                  "monochrome transparency - applies noise with a certain value of transparency "
-                 "(expecting double between 0 and 1), monochrome should be \"true\" or \"false\"";
+                 "(expecting double between 0 and 1), monochrome should be \"true\" or \"false\"\n"
+                 "-threads count - runs the filters on count threads, all hardware threads by default. Larger counts "
+                 "than four per hardware thread are lowered to that. May be given anywhere after the paths";
 }
 
 Console::Console(int argc, char** argv) {
@@ -29,7 +43,25 @@ Console::Console(int argc, char** argv) {
     std::set<std::string_view> allowed_filters = {"-crop", "-gs", "-neg", "-sharp", "-edge", "-blur", "-noise"};
     std::pair<std::string, std::vector<std::string_view>> filter;
     for (int i = 3; i < argc; ++i) {
-        if (allowed_filters.count(argv[i]) != 0) {
+        if (std::string_view(argv[i]) == "-threads") {
+            std::string_view count = i + 1 < argc ? argv[++i] : "";
+            if (count.empty() || count.find_first_not_of("0123456789") != std::string_view::npos) {
+                throw(InputArgumentException("Invalid threads count - expected a non-negative integer\n"));
+            }
+            // More threads than a few per hardware thread only add overhead, and too many cannot even be started
+            const size_t max_threads_count =
+                kMaxThreadsPerHardwareThread * std::max(1u, std::thread::hardware_concurrency());
+            try {
+                parsed_.threads_count = std::stoul(static_cast<std::string>(count));
+            } catch (const std::out_of_range&) {
+                parsed_.threads_count = SIZE_MAX;
+            }
+            if (parsed_.threads_count > max_threads_count) {
+                std::cerr << "Threads count " << count << " is too large, running on " << max_threads_count
+                          << " threads\n";
+                parsed_.threads_count = max_threads_count;
+            }
+        } else if (allowed_filters.count(argv[i]) != 0) {
             if (flag) {
                 parsed_.filters.push_back(filter);
                 filter = {};
@@ -40,5 +72,7 @@ Console::Console(int argc, char** argv) {
             filter.second.push_back(argv[i]);
         }
     }
-    parsed_.filters.push_back(filter);
+    if (flag) {
+        parsed_.filters.push_back(filter);
+    }
 }
\ No newline at end of file
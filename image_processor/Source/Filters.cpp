@@ -1,6 +1,10 @@
 #include "../Headers/Filters.h"
+#include "../Headers/GaussianBlur.h"
 #include "../Headers/MatrixFilter.h"
 
+#include <array>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 #include <cstring>
 #include <string>
@@ -8,29 +12,15 @@
 #include <random>
 #include <ctime>
 
-Image Image::Crop(size_t width, size_t height) const {
-    if (width < 0 || height < 0) {
-        throw FilterArgumentException("Crop arguments must be positive integers\n");
-    }
-    height = std::min(height, m_height_);
-    width = std::min(width, m_width_);
-    Image cropped(width, height);
-    for (size_t j = 0; j < height; ++j) {
-        const std::vector<Color>& source_row = m_colors_[m_height_ - height + j];
-        std::vector<Color>& cropped_row = cropped.m_colors_[j];
-        for (size_t i = 0; i < width; ++i) {
-            cropped_row[i] = source_row[i];
-        }
-    }
-    return cropped;
-}
-
-void Crop(Image& filtered, const Image& image, std::vector<std::string_view> par) {
+void Crop(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> par, ThreadPool&) {
     filtered = image.Crop(std::stoi(static_cast<std::string>(par[0])), std::stoi(static_cast<std::string>(par[1])));
 }
 
+const size_t kLevels = 256;  // of a channel
+
 Image GenerateTemplate(size_t width, size_t height, std::string_view monochrome) {
-    std::srand(std::time(nullptr));
+    // Seeded once, so that templates generated for bands of a streamed image differ from each other
+    [[maybe_unused]] static const bool kSeeded = (std::srand(std::time(nullptr)), true);
     bool bnw;  // NOLINT
     if (static_cast<std::string>(monochrome) == "true") {
         bnw = true;
@@ -40,137 +30,338 @@ Image GenerateTemplate(size_t width, size_t height, std::string_view monochrome)
         throw(FilterArgumentException("Invalid monochrome value - expected true or false\n"));
     }
     const int16_t val = 256;
-    const double normalize = 255.0;
     Image noise(width, height);
     for (size_t y = 0; y < height; ++y) {
+        uint8_t* red = noise.GetRow(kRed, y);
+        uint8_t* green = noise.GetRow(kGreen, y);
+        uint8_t* blue = noise.GetRow(kBlue, y);
         for (size_t x = 0; x < width; ++x) {
-            Color new_color;
-            new_color.r = rand() % val / normalize;
+            red[x] = rand() % val;
             if (bnw) {
-                new_color.g = new_color.r;
-                new_color.b = new_color.g;
+                green[x] = red[x];
+                blue[x] = red[x];
             } else {
-                new_color.g = rand() % val / normalize;
-                new_color.b = rand() % val / normalize;
+                green[x] = rand() % val;
+                blue[x] = rand() % val;
             }
-            noise.SetColor(new_color, x, y);
         }
     }
     return noise;
 }
 
-void Noise(Image& filtered, const Image& image, std::vector<std::string_view> par) {
+// Calls function(y, source, row, width) for every row y of the image, in bands on the pool, with the components of the
+// row indexed by Channel as both the source and the row of the result
+template <class RowFunction>
+void ForEachRow(ComponentImage& filtered, const ComponentImage& image, ThreadPool& pool, const RowFunction& function) {
+    const size_t width = image.GetWidth();
+    filtered.Resize(width, image.GetHeight());
+    ForEachBand(pool, width, image.GetHeight(), [&](size_t begin, size_t end) {
+        std::vector<double> components(kChannelsCount * width);
+        double* row[] = {components.data(), components.data() + width, components.data() + 2 * width};
+        for (size_t y = begin; y < end; ++y) {
+            for (Channel channel : {kRed, kGreen, kBlue}) {
+                ToComponents(image.GetRow(channel, y), width, row[channel]);
+            }
+            function(y, row, row, width);
+            for (Channel channel : {kRed, kGreen, kBlue}) {
+                ToLevels(row[channel], width, filtered.GetRow(channel, y));
+            }
+        }
+    });
+}
+
+// Blends rows of the image with the rows of a noise template of the same size
+struct NoiseBlend {
+    std::shared_ptr<const Image> noise;
+    std::shared_ptr<const std::array<double, kLevels>> noise_products;  // every level of the noise times its weight
+    double transparency;
+
+    void operator()(size_t y, const double* const source[], double* const row[], size_t width) const {
+        for (Channel channel : {kRed, kGreen, kBlue}) {
+            const uint8_t* noise_row = noise->GetRow(channel, y);
+            for (size_t x = 0; x < width; ++x) {
+                row[channel][x] = source[channel][x] * (1 - transparency) + (*noise_products)[noise_row[x]];
+            }
+        }
+    }
+};
+
+NoiseBlend MakeNoiseBlend(const ComponentImage& image, const std::vector<std::string_view>& par) {
     double transparency = std::stod(static_cast<std::string>(par[1]));
     if (transparency < 0 || transparency > 1) {
         throw(FilterArgumentException("Wrong transparency value, expected double between 0 and 1\n"));
     }
-    Image noise = GenerateTemplate(image.GetWidth(), image.GetHeight(), par[0]);
-    filtered.SetWidth(image.GetWidth());
-    filtered.SetHeight(image.GetHeight());
-    for (size_t y = 0; y < image.GetHeight(); ++y) {
-        for (size_t x = 0; x < image.GetWidth(); ++x) {
-            filtered.SetColor((image.GetColor(x, y) * (1 - transparency)) + (noise.GetColor(x, y) * transparency), x,
-                              y);
-        }
+    auto noise = std::make_shared<Image>(GenerateTemplate(image.GetWidth(), image.GetHeight(), par[0]));
+    auto noise_products = std::make_shared<std::array<double, kLevels>>();
+    for (size_t value = 0; value < kLevels; ++value) {
+        (*noise_products)[value] = ToComponent(value) * transparency;
     }
+    return NoiseBlend{std::move(noise), std::move(noise_products), transparency};
 }
 
-void Grayscale(Image& filtered, const Image& image, std::vector<std::string_view> par) {
-    filtered.SetWidth(image.GetWidth());
-    filtered.SetHeight(image.GetHeight());
-    const double r_coeff = 0.299;
-    const double g_coeff = 0.587;
-    const double b_coeff = 0.114;
-    for (size_t y = 0; y < image.GetHeight(); ++y) {
-        for (size_t x = 0; x < image.GetWidth(); ++x) {
-            Color gray_color = image.GetColor(x, y);
-            gray_color.r = r_coeff * gray_color.r + g_coeff * gray_color.g + b_coeff * gray_color.b;
-            gray_color.g = gray_color.r;
-            gray_color.b = gray_color.g;
-            filtered.SetColor(gray_color, x, y);
-        }
+const double kRedWeight = 0.299;
+const double kGreenWeight = 0.587;
+const double kBlueWeight = 0.114;
+
+// Gray levels of row y, as edge detection thresholds them, converting the row to components in 3 * width of them
+void GrayRow(const ComponentImage& image, size_t y, double* components, double* gray) {
+    const size_t width = image.GetWidth();
+    double* red = components;
+    double* green = components + width;
+    double* blue = components + 2 * width;
+    ToComponents(image.GetRow(kRed, y), width, red);
+    ToComponents(image.GetRow(kGreen, y), width, green);
+    ToComponents(image.GetRow(kBlue, y), width, blue);
+    for (size_t x = 0; x < width; ++x) {
+        gray[x] = kRedWeight * red[x] + kGreenWeight * green[x] + kBlueWeight * blue[x];
     }
 }
 
-void Negative(Image& filtered, const Image& image, std::vector<std::string_view> par) {
-    filtered.SetWidth(image.GetWidth());
-    filtered.SetHeight(image.GetHeight());
-    for (size_t y = 0; y < image.GetHeight(); ++y) {
-        for (size_t x = 0; x < image.GetWidth(); ++x) {
-            Color inverted_color = image.GetColor(x, y);
-            inverted_color.r = 1 - inverted_color.r;
-            inverted_color.g = 1 - inverted_color.g;
-            inverted_color.b = 1 - inverted_color.b;
-            filtered.SetColor(inverted_color, x, y);
+void GrayscaleRow(size_t, const double* const source[], double* const row[], size_t width) {
+    for (size_t x = 0; x < width; ++x) {
+        double gray = kRedWeight * source[kRed][x] + kGreenWeight * source[kGreen][x] + kBlueWeight * source[kBlue][x];
+        row[kRed][x] = gray;
+        row[kGreen][x] = gray;
+        row[kBlue][x] = gray;
+    }
+}
+
+void NegativeRow(size_t, const double* const source[], double* const row[], size_t width) {
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        for (size_t x = 0; x < width; ++x) {
+            row[channel][x] = 1 - source[channel][x];
         }
     }
 }
 
-void Sharpening(Image& filtered, const Image& image, std::vector<std::string_view> par) {
-    filtered = MatrixFilter(image, {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}});  // NOLINT: thanks
+PixelKernel NoiseKernel(const ComponentImage& image, std::vector<std::string_view> par) {
+    return MakeNoiseBlend(image, par);
 }
 
-void EdgeDetection(Image& filtered, const Image& image, std::vector<std::string_view> par) {
-    double threshold = std::stod(static_cast<std::string>(par[0]));
-    Grayscale(filtered, image, par);
-    filtered = MatrixFilter(filtered, {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}}, threshold);
+PixelKernel GrayscaleKernel(const ComponentImage&, std::vector<std::string_view>) {
+    return GrayscaleRow;
 }
 
-void GaussianBlur(Image& filtered, const Image& image, std::vector<std::string_view> par) {
-    double sigma = std::stod(static_cast<std::string>(par[0]));
-    filtered.SetWidth(image.GetWidth());
-    filtered.SetHeight(image.GetHeight());
-    size_t size = static_cast<size_t>(std::ceil(6 * std::abs(sigma)));  // NOLINT
-    size += !(size % 2);
-    std::vector<double> coefficients(size);
-    int64_t half = static_cast<int64_t>(coefficients.size() / 2);
-    const double coeff1 = 2 * sigma * sigma;
-    const double coeff2 = std::sqrt(2 * M_PI * sigma * sigma);
-    Image transition(image.GetWidth(), image.GetHeight());  // First iteration, blurring along vertical axis
-    for (int64_t x = 0; x <= half; ++x) {
-        double val = std::exp(-static_cast<double>(x * x) / coeff1) / coeff2;
-        coefficients[half - x] = val;
-        coefficients[half + x] = val;
-    }
-    for (int64_t y = 0; y < static_cast<int64_t>(image.GetHeight()); ++y) {
-        for (int64_t x = 0; x < static_cast<int64_t>(image.GetWidth()); ++x) {
-            Color color;
-            for (int64_t i = -half; i <= half; ++i) {
-                color += image.GetColor(x, y + i) * coefficients[half + i];
-            }
-            transition.SetColor(color, x, y);
-        }
+PixelKernel NegativeKernel(const ComponentImage&, std::vector<std::string_view>) {
+    return NegativeRow;
+}
+
+void ApplyPixelKernels(ComponentImage& filtered, const ComponentImage& image, const std::vector<PixelKernel>& kernels,
+                       ThreadPool& pool) {
+    ForEachRow(filtered, image, pool,
+               [&](size_t y, const double* const source[], double* const row[], size_t width) {
+                   // The kernels work in place on the components of the row while it is in cache
+                   for (const auto& kernel : kernels) {
+                       kernel(y, source, row, width);
+                   }
+               });
+}
+
+void ApplyPixelFilters(ComponentImage& filtered, const ComponentImage& image,
+                       const std::vector<std::pair<std::string, std::vector<std::string_view>>>& filters,
+                       ThreadPool& pool) {
+    if (filters.size() == 1) {
+        ApplyFilter(filtered, image, filters[0], pool);
+        return;
+    }
+    std::vector<PixelKernel> kernels;
+    for (const auto& filter : filters) {
+        kernels.push_back(MakePixelKernel(image, filter));
+    }
+    ApplyPixelKernels(filtered, image, kernels, pool);
+}
+
+void Noise(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> par,
+           ThreadPool& pool) {
+    ForEachRow(filtered, image, pool, MakeNoiseBlend(image, par));
+}
+
+void Grayscale(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view>,
+               ThreadPool& pool) {
+    ForEachRow(filtered, image, pool, GrayscaleRow);
+}
+
+void Negative(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view>,
+              ThreadPool& pool) {
+    ForEachRow(filtered, image, pool, NegativeRow);
+}
+
+void Sharpening(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> par,
+                ThreadPool& pool) {
+    MatrixFilter(filtered, image, {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}}, pool);  // NOLINT: thanks
+}
+
+void EdgeDetection(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> par,
+                   ThreadPool& pool) {
+    double threshold = std::stod(static_cast<std::string>(par[0]));
+    const std::vector<std::vector<double>> matrix = {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}};
+    const size_t width = image.GetWidth();
+    const size_t height = image.GetHeight();
+    filtered.Resize(width, height);
+    if (height == 0) {
+        return;
     }
-    for (int64_t y = 0; y < static_cast<int64_t>(image.GetHeight()); ++y) {
-        for (int64_t x = 0; x < static_cast<int64_t>(image.GetHeight()); ++x) {
-            Color color;
-            for (int64_t i = -half; i <= half; ++i) {
-                color += transition.GetColor(x + i, y) * coefficients[half + i];
+    ForEachBand(pool, width, height, [&](size_t begin, size_t end) {
+        // Gray levels of the last three rows, row y is kept at (y % 3) * width
+        std::vector<double> gray(3 * width);
+        std::vector<double> components(kChannelsCount * width);
+        std::vector<double> sums(width);
+        size_t first = begin == 0 ? 0 : begin - 1;
+        for (size_t y = first; y <= begin; ++y) {
+            GrayRow(image, y, components.data(), gray.data() + (y % 3) * width);
+        }
+        for (size_t y = begin; y < end; ++y) {
+            size_t below = y == 0 ? 0 : y - 1;
+            size_t above = std::min(y + 1, height - 1);
+            if (above > y) {
+                GrayRow(image, above, components.data(), gray.data() + (above % 3) * width);
             }
-            filtered.SetColor(color, x, y);
+            const double* rows[3] = {gray.data() + (below % 3) * width, gray.data() + (y % 3) * width,
+                                     gray.data() + (above % 3) * width};
+            ConvolveRow(rows, matrix, width, sums.data());
+            // ToLevels clamps the sums to [0, 1], which is what the threshold 4 does, as in MatrixFilter
+            if (threshold != 4) {
+                ThresholdRow(sums.data(), width, threshold, sums.data());
+            }
+            uint16_t* red = filtered.GetRow(kRed, y);
+            ToLevels(sums.data(), width, red);
+            std::memcpy(filtered.GetRow(kGreen, y), red, width * sizeof(uint16_t));
+            std::memcpy(filtered.GetRow(kBlue, y), red, width * sizeof(uint16_t));
         }
+    });
+}
+
+// The cascade of boxes blurring within the tolerance faster than the exact blur, if there is one
+std::optional<BoxCascade> FindBoxCascade(double sigma, double tolerance) {
+    // A pass of a box costs about as much as box_cost taps of the exact blur, so boxes only pay off for larger sigmas
+    const size_t box_cost = 5;
+    const size_t min_boxes = 3;
+    const size_t max_boxes = 6;
+    const size_t taps = GaussianCoefficients(sigma).size();
+    for (size_t boxes = min_boxes; tolerance > 0 && boxes <= max_boxes && box_cost * boxes < taps; ++boxes) {
+        BoxCascade cascade = MakeBoxCascade(sigma, boxes);
+        if (cascade.max_error <= tolerance) {
+            return cascade;
+        }
+    }
+    return std::nullopt;
+}
+
+// Sigma and the largest difference from the exact blur allowed, in levels of a channel
+std::pair<double, double> BlurArguments(const std::vector<std::string_view>& par) {
+    double sigma = std::stod(static_cast<std::string>(par[0]));
+    double tolerance = par.size() > 1 ? std::stod(static_cast<std::string>(par[1])) : 0;
+    if (tolerance < 0) {
+        throw(FilterArgumentException("Wrong blur tolerance, expected a non-negative double\n"));
+    }
+    return {sigma, tolerance};
+}
+
+void GaussianBlur(ComponentImage& filtered, const ComponentImage& image, std::vector<std::string_view> par,
+                  ThreadPool& pool) {
+    auto [sigma, tolerance] = BlurArguments(par);
+    if (auto cascade = FindBoxCascade(sigma, tolerance)) {
+        BlurBoxes(filtered, image, *cascade, pool);
+    } else {
+        BlurExact(filtered, image, GaussianCoefficients(sigma), pool);
     }
 }
 
-void ApplyFilter(Image& filtered, const Image& image, std::pair<std::string, std::vector<std::string_view>> filter) {
+// Throws FilterArgumentException unless the filter has as many arguments as it takes, optional ones included
+void CheckArgumentsCount(const std::pair<std::string, std::vector<std::string_view>>& filter) {
     std::unordered_map<std::string, size_t> arg_count = {{"-crop", 2}, {"-gs", 0},   {"-neg", 0},  {"-sharp", 0},
                                                          {"-edge", 1}, {"-blur", 1}, {"-noise", 2}};
-    std::unordered_map<std::string, void (*)(Image&, const Image&, std::vector<std::string_view>)> map = {
+    std::unordered_map<std::string, size_t> optional_arg_count = {{"-blur", 1}};
+    size_t count = filter.second.size();
+    if (count < arg_count[filter.first] || count > arg_count[filter.first] + optional_arg_count[filter.first]) {
+        throw FilterArgumentException("Invalid \"" + filter.first + "\" arguments count. See help for reference\n");
+    }
+}
+
+void ApplyFilter(ComponentImage& filtered, const ComponentImage& image,
+                 std::pair<std::string, std::vector<std::string_view>> filter, ThreadPool& pool) {
+    std::unordered_map<std::string,
+                       void (*)(ComponentImage&, const ComponentImage&, std::vector<std::string_view>, ThreadPool&)>
+        map = {
         {"-gs", Grayscale},      {"-neg", Negative}, {"-sharp", Sharpening}, {"-edge", EdgeDetection},
         {"-blur", GaussianBlur}, {"-crop", Crop},    {"-noise", Noise}};
-    if (arg_count[filter.first] != filter.second.size()) {
-        throw FilterArgumentException("Invalid \"" + filter.first + "\" arguments count. See help for reference\n");
+    CheckArgumentsCount(filter);
+    try {
+        map[filter.first](filtered, image, filter.second, pool);
+    } catch (const std::invalid_argument& error) {
+        throw FilterArgumentException("Invalid \"" + filter.first + "\" argument type. See help for reference\n");
     }
+}
+
+PixelKernel MakePixelKernel(const ComponentImage& image,
+                            const std::pair<std::string, std::vector<std::string_view>>& filter) {
+    std::unordered_map<std::string, PixelKernel (*)(const ComponentImage&, std::vector<std::string_view>)>
+        pixel_filters = {{"-gs", GrayscaleKernel}, {"-neg", NegativeKernel}, {"-noise", NoiseKernel}};
+    auto pixel_filter = pixel_filters.find(filter.first);
+    if (pixel_filter == pixel_filters.end()) {
+        return nullptr;
+    }
+    CheckArgumentsCount(filter);
     try {
-        map[filter.first](filtered, image, filter.second);
+        return pixel_filter->second(image, filter.second);
     } catch (const std::invalid_argument& error) {
         throw FilterArgumentException("Invalid \"" + filter.first + "\" argument type. See help for reference\n");
     }
 }
 
-void FilterChain(Image& image, std::vector<std::pair<std::string, std::vector<std::string_view>>> filters) {
-    const Image& start = image;
-    for (size_t i = 0; i < filters.size(); ++i) {
-        ApplyFilter(image, start, filters[i]);
+size_t FilterContext(const std::pair<std::string, std::vector<std::string_view>>& filter) {
+    CheckArgumentsCount(filter);
+    try {
+        if (filter.first == "-crop") {
+            std::stoi(static_cast<std::string>(filter.second[0]));
+            std::stoi(static_cast<std::string>(filter.second[1]));
+        } else if (filter.first == "-edge") {
+            std::stod(static_cast<std::string>(filter.second[0]));
+            return 1;
+        } else if (filter.first == "-sharp") {
+            return 1;
+        } else if (filter.first == "-blur") {
+            auto [sigma, tolerance] = BlurArguments(filter.second);
+            if (auto cascade = FindBoxCascade(sigma, tolerance)) {
+                size_t margin = 0;
+                for (size_t box : cascade->widths) {
+                    margin += box / 2;
+                }
+                return margin;
+            }
+            return GaussianCoefficients(sigma).size() / 2;
+        } else {
+            MakePixelKernel(ComponentImage(0, 0), filter);
+        }
+    } catch (const std::invalid_argument& error) {
+        throw FilterArgumentException("Invalid \"" + filter.first + "\" argument type. See help for reference\n");
     }
-}
\ No newline at end of file
+    return 0;
+}
+
+void FilterChain(ComponentImage& image, std::vector<std::pair<std::string, std::vector<std::string_view>>> filters,
+                 size_t threads_count) {
+    ThreadPool pool(threads_count);
+    // Consecutive per-pixel filters are applied in a single pass over the image, so that only the filters which
+    // need neighbouring pixels materialize their input
+    std::vector<std::pair<std::string, std::vector<std::string_view>>> pixel_filters;
+    auto apply_pixel_filters = [&] {
+        if (!pixel_filters.empty()) {
+            ComponentImage filtered(0, 0);
+            ApplyPixelFilters(filtered, image, pixel_filters, pool);
+            image = std::move(filtered);
+            pixel_filters.clear();
+        }
+    };
+    for (const auto& filter : filters) {
+        if (MakePixelKernel(ComponentImage(0, 0), filter)) {
+            pixel_filters.push_back(filter);
+            continue;
+        }
+        apply_pixel_filters();
+        ComponentImage filtered(0, 0);
+        ApplyFilter(filtered, image, filter, pool);
+        image = std::move(filtered);
+    }
+    apply_pixel_filters();
+}
@@ -0,0 +1,300 @@
+#include "../Headers/GaussianBlur.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GAUSSIAN_BLUR_X86
+#endif
+
+namespace {
+
+// Columns of the horizontal pass processed at once, their sums stay in the first level cache across the taps
+const size_t kStripWidth = 512;
+// Bytes of the source rows around a row the vertical pass keeps for a strip of columns, which sets the width of the
+// strips so that they stay in the second level cache
+const size_t kStripRowsBytes = 1 << 17;
+// Columns of the vertical passes of the boxes. Strips of the whole height of the image are processed at once.
+const size_t kBoxStripWidth = 16;
+// Fractional bits of the fixed point values of the boxes. The values between the horizontal and the vertical passes
+// are stored in 16 bits with kStoredBits fractional bits.
+const int kFractionBits = 16;
+const int kStoredBits = 8;
+// The fixed point value of the component 1, the largest level of a channel
+const double kLevel = static_cast<double>(UINT8_MAX << kFractionBits);
+
+// sums[x] += values[x] * coefficient, one product per column, so the order of the sums is kept and vectors give
+// exactly the same results
+void AddScaledScalar(const double* values, double coefficient, size_t count, double* sums) {
+    for (size_t x = 0; x < count; ++x) {
+        sums[x] += values[x] * coefficient;
+    }
+}
+
+#ifdef GAUSSIAN_BLUR_X86
+__attribute__((target("avx2"))) void AddScaledAvx2(const double* values, double coefficient, size_t count,
+                                                   double* sums) {
+    const __m256d factor = _mm256_set1_pd(coefficient);
+    size_t x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m256d product = _mm256_mul_pd(_mm256_loadu_pd(values + x), factor);
+        _mm256_storeu_pd(sums + x, _mm256_add_pd(_mm256_loadu_pd(sums + x), product));
+    }
+    AddScaledScalar(values + x, coefficient, count - x, sums + x);
+}
+
+void AddScaledSse2(const double* values, double coefficient, size_t count, double* sums) {
+    const __m128d factor = _mm_set1_pd(coefficient);
+    size_t x = 0;
+    for (; x + 2 <= count; x += 2) {
+        __m128d product = _mm_mul_pd(_mm_loadu_pd(values + x), factor);
+        _mm_storeu_pd(sums + x, _mm_add_pd(_mm_loadu_pd(sums + x), product));
+    }
+    AddScaledScalar(values + x, coefficient, count - x, sums + x);
+}
+
+bool Avx2Supported() {
+    static const bool kSupported = __builtin_cpu_supports("avx2");
+    return kSupported;
+}
+#endif
+
+void AddScaled(const double* values, double coefficient, size_t count, double* sums) {
+#ifdef GAUSSIAN_BLUR_X86
+    if (Avx2Supported()) {
+        AddScaledAvx2(values, coefficient, count, sums);
+    } else {
+        AddScaledSse2(values, coefficient, count, sums);
+    }
+#else
+    AddScaledScalar(values, coefficient, count, sums);
+#endif
+}
+
+// Box blur of width 2 * radius + 1 along count interleaved lines of the given length, as the rows of a strip of
+// columns are, which leaves lines shorter by 2 * radius. The averages are rounded, dividing by the width with a
+// multiplication by its inverse in 32 bit fixed point, which is off by less than a thousandth.
+template <size_t count>
+void BoxPass(const int32_t* values, size_t length, size_t radius, int64_t* sums, int32_t* result) {
+    const int shift = 32;
+    const int64_t inverse = std::llround(std::ldexp(1.0 / static_cast<double>(2 * radius + 1), shift));
+    const int64_t half = int64_t{1} << (shift - 1);
+    std::fill(sums, sums + count, 0);
+    for (size_t i = 0; i < 2 * radius; ++i) {
+        for (size_t j = 0; j < count; ++j) {
+            sums[j] += values[i * count + j];
+        }
+    }
+    for (size_t i = 0; i + 2 * radius < length; ++i) {
+        const int32_t* added = values + (i + 2 * radius) * count;
+        for (size_t j = 0; j < count; ++j) {
+            sums[j] += added[j];
+            result[i * count + j] = static_cast<int32_t>((sums[j] * inverse + half) >> shift);
+            sums[j] -= values[i * count + j];
+        }
+    }
+}
+
+// Difference of the approximate and the exact blur of an image, as in the proof of the bound: the two dimensional
+// kernels are outer products of the one dimensional ones, and an image of zeros and ones where their difference is
+// positive, or negative, is the worst one
+double KernelsDifference(const std::vector<double>& approximate, const std::vector<double>& exact) {
+    const size_t length = std::max(approximate.size(), exact.size());
+    std::vector<double> a(length);
+    std::vector<double> b(length);
+    std::copy(approximate.begin(), approximate.end(), a.begin() + (length - approximate.size()) / 2);
+    std::copy(exact.begin(), exact.end(), b.begin() + (length - exact.size()) / 2);
+    double positive = 0;
+    double negative = 0;
+    for (size_t i = 0; i < length; ++i) {
+        for (size_t j = 0; j < length; ++j) {
+            double difference = a[i] * a[j] - b[i] * b[j];
+            (difference > 0 ? positive : negative) += std::abs(difference);
+        }
+    }
+    return std::max(positive, negative);
+}
+
+}  // namespace
+
+std::vector<double> GaussianCoefficients(double sigma) {
+    size_t size = static_cast<size_t>(std::ceil(6 * std::abs(sigma)));  // NOLINT
+    size += !(size % 2);
+    std::vector<double> coefficients(size);
+    int64_t half = static_cast<int64_t>(coefficients.size() / 2);
+    const double coeff1 = 2 * sigma * sigma;
+    const double coeff2 = std::sqrt(2 * M_PI * sigma * sigma);
+    for (int64_t x = 0; x <= half; ++x) {
+        double val = std::exp(-static_cast<double>(x * x) / coeff1) / coeff2;
+        coefficients[half - x] = val;
+        coefficients[half + x] = val;
+    }
+    return coefficients;
+}
+
+void BlurExact(ComponentImage& filtered, const ComponentImage& image, const std::vector<double>& coefficients,
+               ThreadPool& pool) {
+    const size_t size = coefficients.size();
+    const size_t half = size / 2;
+    const size_t width = image.GetWidth();
+    const size_t height = image.GetHeight();
+    filtered.Resize(width, height);
+    if (width == 0 || height == 0) {
+        return;
+    }
+    // Every band converts its rows and the half rows around it only once per channel, so the taller the better
+    const size_t band_rows = std::max(kBandPixels / std::max<size_t>(1, width), half);
+    pool.ParallelFor(height, band_rows, [&](size_t begin, size_t end) {
+        const size_t strip_width = std::min(width, std::max<size_t>(8, kStripRowsBytes / sizeof(double) / size));
+        // Rows of the band blurred along the columns
+        std::vector<double> transition((end - begin) * width);
+        // Components of the last size rows of the strip, the source row y + half - begin is kept at (y % size)
+        std::vector<double> rows(size * strip_width);
+        // Transition row extended by half columns with the border values on each side
+        std::vector<double> extended(width + 2 * half);
+        std::vector<double> sums(width);
+        auto source_row = [&](Channel channel, int64_t y) {
+            return image.GetRow(channel, std::min<int64_t>(height - 1, std::max<int64_t>(0, y)));
+        };
+        for (Channel channel : {kRed, kGreen, kBlue}) {
+            std::fill(transition.begin(), transition.end(), 0);
+            for (size_t first = 0; first < width; first += strip_width) {
+                const size_t count = std::min(strip_width, width - first);
+                auto convert = [&](size_t y) {  // source row y - half
+                    const int64_t row = static_cast<int64_t>(y) - static_cast<int64_t>(half);
+                    ToComponents(source_row(channel, row) + first, count, rows.data() + (y % size) * strip_width);
+                };
+                for (size_t y = begin; y + 1 < begin + size; ++y) {
+                    convert(y);
+                }
+                for (size_t y = begin; y < end; ++y) {
+                    convert(y + size - 1);
+                    double* sum = transition.data() + (y - begin) * width + first;
+                    for (size_t i = 0; i < size; ++i) {
+                        AddScaled(rows.data() + ((y + i) % size) * strip_width, coefficients[i], count, sum);
+                    }
+                }
+            }
+            for (size_t y = begin; y < end; ++y) {
+                const double* row = transition.data() + (y - begin) * width;
+                std::fill(extended.begin(), extended.begin() + half, row[0]);
+                std::copy(row, row + width, extended.begin() + half);
+                std::fill(extended.begin() + half + width, extended.end(), row[width - 1]);
+                std::fill(sums.begin(), sums.end(), 0);
+                for (size_t first = 0; first < width; first += kStripWidth) {
+                    const size_t count = std::min(kStripWidth, width - first);
+                    for (size_t i = 0; i < size; ++i) {
+                        AddScaled(extended.data() + first + i, coefficients[i], count, sums.data() + first);
+                    }
+                }
+                ToLevels(sums.data(), width, filtered.GetRow(channel, y));
+            }
+        }
+    });
+}
+
+BoxCascade MakeBoxCascade(double sigma, size_t boxes_count) {
+    // Widths making the variance of the cascade closest to sigma squared: the narrower ones first, then the wider
+    const double boxes = static_cast<double>(boxes_count);
+    const double variance = sigma * sigma;
+    size_t lower = static_cast<size_t>(std::sqrt(12 * variance / boxes + 1));
+    lower -= lower % 2 == 0 && lower > 1;
+    const double narrow = std::round((12 * variance - boxes * lower * lower - 4 * boxes * lower - 3 * boxes) /
+                                     (-4.0 * lower - 4));
+    BoxCascade cascade;
+    for (size_t i = 0; i < boxes_count; ++i) {
+        cascade.widths.push_back(static_cast<double>(i) < narrow ? lower : lower + 2);
+    }
+    std::vector<double> coefficients = GaussianCoefficients(sigma);
+    std::vector<double> kernel = {1};
+    for (size_t width : cascade.widths) {
+        std::vector<double> next(kernel.size() + width - 1);
+        for (size_t i = 0; i < kernel.size(); ++i) {
+            for (size_t j = 0; j < width; ++j) {
+                next[i + j] += kernel[i] / static_cast<double>(width);
+            }
+        }
+        kernel = std::move(next);
+    }
+    cascade.scale = 0;
+    for (double coefficient : coefficients) {
+        cascade.scale += coefficient;
+    }
+    for (auto& value : kernel) {
+        value *= cascade.scale;
+    }
+    // The fixed point roundings add less than 0.05 levels
+    const double rounding = 0.05;
+    cascade.max_error = std::floor(UINT8_MAX * KernelsDifference(kernel, coefficients) + rounding) + 1;
+    return cascade;
+}
+
+void BlurBoxes(ComponentImage& filtered, const ComponentImage& image, const BoxCascade& cascade, ThreadPool& pool) {
+    const size_t width = image.GetWidth();
+    const size_t height = image.GetHeight();
+    size_t margin = 0;  // the rows and columns around a pixel the cascade reads
+    for (size_t box : cascade.widths) {
+        margin += box / 2;
+    }
+    filtered.Resize(width, height);
+    if (width == 0 || height == 0) {
+        return;
+    }
+    // Rows blurred horizontally, for one channel at a time
+    std::vector<uint16_t> horizontal(width * height);
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        ForEachBand(pool, width, height, [&](size_t begin, size_t end) {
+            std::vector<int32_t> values(width + 2 * margin);
+            std::vector<int32_t> next(values.size());
+            std::vector<int64_t> sums(1);
+            for (size_t y = begin; y < end; ++y) {
+                const uint16_t* row = image.GetRow(channel, y);
+                for (size_t x = 0; x < values.size(); ++x) {
+                    size_t column = std::min(width - 1, static_cast<size_t>(std::max<int64_t>(
+                                                            0, static_cast<int64_t>(x) - static_cast<int64_t>(margin))));
+                    values[x] = static_cast<int32_t>(std::lround(FromLevel(row[column]) * kLevel));
+                }
+                size_t length = values.size();
+                for (size_t box : cascade.widths) {
+                    BoxPass<1>(values.data(), length, box / 2, sums.data(), next.data());
+                    values.swap(next);
+                    length -= box - 1;
+                }
+                const int32_t half = 1 << (kFractionBits - kStoredBits - 1);
+                for (size_t x = 0; x < width; ++x) {
+                    horizontal[y * width + x] = (values[x] + half) >> (kFractionBits - kStoredBits);
+                }
+            }
+        });
+        const size_t strips_count = (width + kBoxStripWidth - 1) / kBoxStripWidth;
+        pool.ParallelFor(strips_count, 1, [&](size_t begin, size_t end) {
+            std::vector<int32_t> values((height + 2 * margin) * kBoxStripWidth);
+            std::vector<int32_t> next(values.size());
+            std::vector<int64_t> sums(kBoxStripWidth);
+            for (size_t strip = begin; strip < end; ++strip) {
+                const size_t first = strip * kBoxStripWidth;
+                const size_t count = std::min(kBoxStripWidth, width - first);
+                for (size_t y = 0; y < height + 2 * margin; ++y) {
+                    size_t row = std::min(height - 1, static_cast<size_t>(std::max<int64_t>(
+                                                          0, static_cast<int64_t>(y) - static_cast<int64_t>(margin))));
+                    for (size_t x = 0; x < kBoxStripWidth; ++x) {
+                        values[y * kBoxStripWidth + x] = horizontal[row * width + first + std::min(x, count - 1)];
+                    }
+                }
+                size_t length = height + 2 * margin;
+                for (size_t box : cascade.widths) {
+                    BoxPass<kBoxStripWidth>(values.data(), length, box / 2, sums.data(), next.data());
+                    values.swap(next);
+                    length -= box - 1;
+                }
+                const double factor = cascade.scale / (1 << kStoredBits) / UINT8_MAX;
+                for (size_t y = 0; y < height; ++y) {
+                    uint16_t* row = filtered.GetRow(channel, y);
+                    for (size_t x = 0; x < count; ++x) {
+                        row[first + x] = ToLevel(values[y * kBoxStripWidth + x] * factor);
+                    }
+                }
+            }
+        });
+    }
+}
@@ -1,8 +1,14 @@
 #include "../Headers/Image.h"
 
+#include <array>
 #include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_X86
+#endif
 
-const double F = 255.0;
 const int16_t FIVE = 5;
 const int16_t SIX = 6;
 const int16_t SEVEN = 7;
@@ -22,148 +28,429 @@ void Normalize(size_t& coordinate, size_t limit) {
     }
 }
 
-Color::Color() : r(0), g(0), b(0) {
+namespace {
+
+// Masks for _mm_shuffle_epi8 moving bytes between 16 pixels of a BMP row, 48 bytes in three vectors, and 16 bytes
+// of a plane. split[channel][vector] takes the bytes of the channel from the vector to their places in the plane,
+// merge[vector][channel] takes them from the plane to their places in the vector. Zero bytes are marked with 0x80.
+struct ShuffleMasks {
+    alignas(16) uint8_t split[3][3][16];
+    alignas(16) uint8_t merge[3][3][16];
+};
+
+constexpr ShuffleMasks MakeShuffleMasks() {
+    ShuffleMasks masks = {};
+    for (size_t channel = 0; channel < 3; ++channel) {
+        for (size_t vector = 0; vector < 3; ++vector) {
+            for (size_t byte = 0; byte < 16; ++byte) {
+                size_t bgr_byte = 3 * byte + channel;
+                masks.split[channel][vector][byte] = bgr_byte / 16 == vector ? bgr_byte % 16 : 0x80;
+                size_t pixel = (16 * vector + byte) / 3;
+                masks.merge[vector][channel][byte] = (16 * vector + byte) % 3 == channel ? pixel : 0x80;
+            }
+        }
+    }
+    return masks;
 }
 
-Color::Color(double r, double g, double b) : r(r), g(g), b(b) {
+constexpr ShuffleMasks kShuffleMasks = MakeShuffleMasks();
+
+// Pixels from first on, the vectorized loops stop at a multiple of 16
+void SplitBgrScalar(const uint8_t* bgr, size_t first, size_t width, uint8_t* red, uint8_t* green, uint8_t* blue) {
+    for (size_t x = first; x < width; ++x) {
+        blue[x] = bgr[3 * x];
+        green[x] = bgr[3 * x + 1];
+        red[x] = bgr[3 * x + 2];
+    }
 }
 
-Image::Image(size_t width, size_t height) {
-    m_width_ = width;
-    m_height_ = height;
-    m_colors_.resize(height);
-    for (size_t i = 0; i < height; ++i) {
-        m_colors_[i].resize(width);
+void MergeBgrScalar(const uint8_t* red, const uint8_t* green, const uint8_t* blue, size_t first, size_t width,
+                    uint8_t* bgr) {
+    for (size_t x = first; x < width; ++x) {
+        bgr[3 * x] = blue[x];
+        bgr[3 * x + 1] = green[x];
+        bgr[3 * x + 2] = red[x];
     }
 }
 
-Color Image::GetColor(size_t x, size_t y) const {
-    Normalize(x, m_width_);
-    Normalize(y, m_height_);
-    return m_colors_[y][x];
+#ifdef IMAGE_X86
+__attribute__((target("ssse3"))) void SplitBgrSsse3(const uint8_t* bgr, size_t width, uint8_t* red, uint8_t* green,
+                                                    uint8_t* blue) {
+    uint8_t* planes[3] = {blue, green, red};
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i vectors[3];
+        for (size_t vector = 0; vector < 3; ++vector) {
+            vectors[vector] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr + 3 * x + 16 * vector));
+        }
+        for (size_t channel = 0; channel < 3; ++channel) {
+            __m128i plane = _mm_setzero_si128();
+            for (size_t vector = 0; vector < 3; ++vector) {
+                __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(kShuffleMasks.split[channel][vector]));
+                plane = _mm_or_si128(plane, _mm_shuffle_epi8(vectors[vector], mask));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[channel] + x), plane);
+        }
+    }
+    SplitBgrScalar(bgr, x, width, red, green, blue);
 }
 
-void Image::SetColor(const Color& color, size_t x, size_t y) {
-    m_colors_[y][x].r = color.r;
-    m_colors_[y][x].g = color.g;
-    m_colors_[y][x].b = color.b;
+__attribute__((target("ssse3"))) void MergeBgrSsse3(const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+                                                    size_t width, uint8_t* bgr) {
+    const uint8_t* planes[3] = {blue, green, red};
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i channels[3];
+        for (size_t channel = 0; channel < 3; ++channel) {
+            channels[channel] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[channel] + x));
+        }
+        for (size_t vector = 0; vector < 3; ++vector) {
+            __m128i bytes = _mm_setzero_si128();
+            for (size_t channel = 0; channel < 3; ++channel) {
+                __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(kShuffleMasks.merge[vector][channel]));
+                bytes = _mm_or_si128(bytes, _mm_shuffle_epi8(channels[channel], mask));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bgr + 3 * x + 16 * vector), bytes);
+        }
+    }
+    MergeBgrScalar(red, green, blue, x, width, bgr);
 }
 
-void Image::SetHeight(size_t height) {
-    m_height_ = height;
+bool Ssse3Supported() {
+    static const bool kSupported = __builtin_cpu_supports("ssse3");
+    return kSupported;
 }
+#endif
 
-void Image::SetWidth(size_t width) {
-    m_width_ = width;
+}  // namespace
+
+void SplitBgr(const uint8_t* bgr, size_t width, uint8_t* red, uint8_t* green, uint8_t* blue) {
+#ifdef IMAGE_X86
+    if (Ssse3Supported()) {
+        SplitBgrSsse3(bgr, width, red, green, blue);
+        return;
+    }
+#endif
+    SplitBgrScalar(bgr, 0, width, red, green, blue);
 }
 
-void Image::Export(std::ofstream& os) const {
-    unsigned char bmp_pad[3] = {0, 0, 0};
-    const size_t padding_amount = ((4 - (m_width_ * 3) % 4) % 4);
+void MergeBgr(const uint8_t* red, const uint8_t* green, const uint8_t* blue, size_t width, uint8_t* bgr) {
+#ifdef IMAGE_X86
+    if (Ssse3Supported()) {
+        MergeBgrSsse3(red, green, blue, width, bgr);
+        return;
+    }
+#endif
+    MergeBgrScalar(red, green, blue, 0, width, bgr);
+}
 
-    const size_t file_header_size = 14;
-    const size_t information_header_size = 40;
-    const size_t file_size =
-        file_header_size + information_header_size + m_width_ * m_height_ * 3 + padding_amount * m_height_;
+void ToComponents(const uint16_t* levels, size_t width, double* components) {
+    size_t x = 0;
+#ifdef IMAGE_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128d max = _mm_set1_pd(UINT16_MAX);
+    // Widens 4 levels to 32 bits and divides them as FromLevel does
+    auto store = [&](__m128i values, double* destination) {
+        _mm_storeu_pd(destination, _mm_div_pd(_mm_cvtepi32_pd(values), max));
+        _mm_storeu_pd(destination + 2, _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(values, 8)), max));
+    };
+    for (; x + 8 <= width; x += 8) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(levels + x));
+        store(_mm_unpacklo_epi16(values, zero), components + x);
+        store(_mm_unpackhi_epi16(values, zero), components + x + 4);
+    }
+#endif
+    for (; x < width; ++x) {
+        components[x] = FromLevel(levels[x]);
+    }
+}
 
-    unsigned char file_header[file_header_size] = {
-        'B',
-        'M',
-        static_cast<unsigned char>(file_size),
-        static_cast<unsigned char>(file_size >> EIGHT),
-        static_cast<unsigned char>(file_size >> SIXTEEN),
-        static_cast<unsigned char>(file_size >> TWENTY_FOUR),
+void ToLevels(const double* components, size_t width, uint16_t* levels) {
+    size_t x = 0;
+#ifdef IMAGE_X86
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d max = _mm_set1_pd(UINT8_MAX);
+    const __m128d steps = _mm_set1_pd(kFractionSteps);
+    const __m128i byte_steps = _mm_set1_epi32(kLevelsPerByte);
+    const __m128i bias = _mm_set1_epi32(INT16_MIN);
+    // The same operations as ToLevel, two components at a time, giving the levels in the low 32-bit lanes. The
+    // fraction is rounded up by adding 1, subtracting the all ones mask, where it exceeds its truncation.
+    auto level = [&](size_t offset) {
+        __m128d scaled = _mm_min_pd(max, _mm_max_pd(_mm_mul_pd(_mm_loadu_pd(components + offset), max), zero));
+        __m128i bytes = _mm_cvttpd_epi32(scaled);
+        __m128d fraction = _mm_mul_pd(_mm_sub_pd(scaled, _mm_cvtepi32_pd(bytes)), steps);
+        __m128i truncated = _mm_cvttpd_epi32(fraction);
+        __m128i above = _mm_castpd_si128(_mm_cmplt_pd(_mm_cvtepi32_pd(truncated), fraction));
+        __m128i rounded = _mm_sub_epi32(truncated, _mm_move_epi64(_mm_shuffle_epi32(above, _MM_SHUFFLE(3, 3, 2, 0))));
+        return _mm_add_epi32(_mm_mullo_epi16(bytes, byte_steps), rounded);
     };
+    for (; x + 8 <= width; x += 8) {
+        __m128i low = _mm_unpacklo_epi64(level(x), level(x + 2));
+        __m128i high = _mm_unpacklo_epi64(level(x + 4), level(x + 6));
+        // Packs the levels with signed saturation, shifted into the signed range and back
+        __m128i packed = _mm_packs_epi32(_mm_add_epi32(low, bias), _mm_add_epi32(high, bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + x), _mm_xor_si128(packed, _mm_set1_epi16(INT16_MIN)));
+    }
+#endif
+    for (; x < width; ++x) {
+        levels[x] = ToLevel(components[x]);
+    }
+}
 
-    file_header[TEN] = file_header_size + information_header_size;
+void BytesToLevels(const uint8_t* bytes, size_t width, uint16_t* levels) {
+    size_t x = 0;
+#ifdef IMAGE_X86
+    // Level 257 b has the byte b in both halves
+    for (; x + 16 <= width; x += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + x), _mm_unpacklo_epi8(values, values));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + x + 8), _mm_unpackhi_epi8(values, values));
+    }
+#endif
+    for (; x < width; ++x) {
+        levels[x] = bytes[x] * kLevelsPerByte;
+    }
+}
 
-    unsigned char information_header[information_header_size] = {information_header_size,
-                                                                 0,
-                                                                 0,
-                                                                 0,
-                                                                 static_cast<unsigned char>(m_width_),
-                                                                 static_cast<unsigned char>(m_width_ >> EIGHT),
-                                                                 static_cast<unsigned char>(m_width_ >> SIXTEEN),
-                                                                 static_cast<unsigned char>(m_width_ >> TWENTY_FOUR),
-                                                                 static_cast<unsigned char>(m_height_),
-                                                                 static_cast<unsigned char>(m_height_ >> EIGHT),
-                                                                 static_cast<unsigned char>(m_height_ >> SIXTEEN),
-                                                                 static_cast<unsigned char>(m_height_ >> TWENTY_FOUR),
-                                                                 1,
-                                                                 0,
-                                                                 TWENTY_FOUR};
+void LevelsToBytes(const uint16_t* levels, size_t width, uint8_t* bytes) {
+    size_t x = 0;
+#ifdef IMAGE_X86
+    // Divides by 257 as the high half of the product with ceil(2^24 / 257), shifted right by 8 more bits
+    const __m128i inverse = _mm_set1_epi16(static_cast<int16_t>(65281));
+    auto divide = [&](size_t offset) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(levels + offset));
+        return _mm_srli_epi16(_mm_mulhi_epu16(values, inverse), 8);
+    };
+    for (; x + 16 <= width; x += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + x), _mm_packus_epi16(divide(x), divide(x + 8)));
+    }
+#endif
+    for (; x < width; ++x) {
+        bytes[x] = levels[x] / kLevelsPerByte;
+    }
+}
 
-    os.write(reinterpret_cast<char*>(file_header), file_header_size);
-    os.write(reinterpret_cast<char*>(information_header), information_header_size);
+Color::Color() : r(0), g(0), b(0) {
+}
 
-    for (size_t y = 0; y < m_height_; ++y) {
-        for (size_t x = 0; x < m_width_; ++x) {
-            unsigned char r = static_cast<unsigned char>(GetColor(x, y).r * F);
-            unsigned char g = static_cast<unsigned char>(GetColor(x, y).g * F);
-            unsigned char b = static_cast<unsigned char>(GetColor(x, y).b * F);
+Color::Color(double r, double g, double b) : r(r), g(g), b(b) {
+}
 
-            unsigned char color[] = {b, g, r};
+template <class Value>
+BasicImage<Value>::BasicImage(size_t width, size_t height)
+    : m_width_(width),
+      m_height_(height),
+      m_stride_((width * sizeof(Value) + kRowAlignment - 1) / kRowAlignment * kRowAlignment / sizeof(Value)),
+      m_pixels_(kChannelsCount * m_stride_ * height) {
+}
 
-            os.write(reinterpret_cast<char*>(color), 3);
-        }
+template <class Value>
+Color BasicImage<Value>::GetColor(size_t x, size_t y) const {
+    Normalize(x, m_width_);
+    Normalize(y, m_height_);
+    if constexpr (std::is_same_v<Value, uint8_t>) {
+        return Color{ToComponent(GetRow(kRed, y)[x]), ToComponent(GetRow(kGreen, y)[x]),
+                     ToComponent(GetRow(kBlue, y)[x])};
+    } else {
+        return Color{FromLevel(GetRow(kRed, y)[x]), FromLevel(GetRow(kGreen, y)[x]), FromLevel(GetRow(kBlue, y)[x])};
+    }
+}
 
-        os.write(reinterpret_cast<char*>(bmp_pad), static_cast<int64_t>(padding_amount));
+template <class Value>
+void BasicImage<Value>::SetColor(const Color& color, size_t x, size_t y) {
+    if constexpr (std::is_same_v<Value, uint8_t>) {
+        GetRow(kRed, y)[x] = ToByte(color.r);
+        GetRow(kGreen, y)[x] = ToByte(color.g);
+        GetRow(kBlue, y)[x] = ToByte(color.b);
+    } else {
+        GetRow(kRed, y)[x] = ToLevel(color.r);
+        GetRow(kGreen, y)[x] = ToLevel(color.g);
+        GetRow(kBlue, y)[x] = ToLevel(color.b);
     }
+}
 
-    os.close();
+template <class Value>
+Value* BasicImage<Value>::GetRow(Channel channel, size_t y) {
+    return m_pixels_.data() + (channel * m_height_ + y) * m_stride_;
+}
 
-    if (!os.fail()) {
-        std::cout << "File created successfully.\n";
-    } else {
-        std::cerr << "Error creating file. Check if there is enough space on the drive.\n";
+template <class Value>
+const Value* BasicImage<Value>::GetRow(Channel channel, size_t y) const {
+    return m_pixels_.data() + (channel * m_height_ + y) * m_stride_;
+}
+
+template <class Value>
+void BasicImage<Value>::Export(std::ofstream& os) const {
+    BmpWriter writer(os, m_width_, m_height_);
+    writer.WriteRows(*this, 0, m_height_);
+    writer.Finish();
+}
+
+template <class Value>
+void BasicImage<Value>::Read(std::ifstream& of) {
+    BmpReader reader(of);
+    if (!reader.IsBmp()) {
+        of.close();
+        std::cerr << "The specified path is not a BMP image\n";
+        return;
     }
+    *this = BasicImage(reader.GetWidth(), reader.GetHeight());
+    reader.ReadRows(*this, 0, m_height_);
+    reader.Finish();
 }
 
-void Image::Read(std::ifstream& of) {
+BmpReader::BmpReader(std::ifstream& in) : m_in_(in) {
     const size_t file_header_size = 14;
     const size_t information_header_size = 40;
 
     unsigned char file_header[file_header_size];
-    of.read(reinterpret_cast<char*>(file_header), file_header_size);
+    m_in_.read(reinterpret_cast<char*>(file_header), file_header_size);
 
     if (file_header[0] != 'B' && file_header[1] != 'M') {
-        of.close();
-        std::cerr << "The specified path is not a BMP image\n";
         return;
     }
+    m_bmp_ = true;
 
     unsigned char information_header[information_header_size];
-    of.read(reinterpret_cast<char*>(information_header), information_header_size);
+    m_in_.read(reinterpret_cast<char*>(information_header), information_header_size);
 
     m_width_ = information_header[4] + information_header[FIVE] * P1 + information_header[SIX] * P2 +
                information_header[SEVEN] * P3;
     m_height_ = information_header[EIGHT] + information_header[NINE] * P1 + information_header[TEN] * P2 +
                 information_header[ELEVEN] * P3;
 
-    m_colors_.resize(m_height_);
-    for (size_t i = 0; i < m_height_; ++i) {
-        m_colors_[i].resize(m_width_);
-    }
-
     const size_t padding_amount = (4 - (m_width_ * 3) % 4) % 4;
+    m_row_size_ = m_width_ * 3 + padding_amount;
+}
 
-    for (size_t y = 0; y < m_height_; ++y) {
-        for (size_t x = 0; x < m_width_; ++x) {
-            unsigned char color[3];
-            of.read(reinterpret_cast<char*>(color), 3);
+bool BmpReader::IsBmp() const {
+    return m_bmp_;
+}
 
-            m_colors_[y][x].r = static_cast<double>(color[2]) / F;
-            m_colors_[y][x].g = static_cast<double>(color[1]) / F;
-            m_colors_[y][x].b = static_cast<double>(color[0]) / F;
-        }
+size_t BmpReader::GetWidth() const {
+    return m_width_;
+}
 
-        of.ignore(static_cast<int64_t>(padding_amount));
+size_t BmpReader::GetHeight() const {
+    return m_height_;
+}
+
+template <class SplitRow>
+void BmpReader::ReadBlocks(size_t count, SplitRow split_row) {
+    const size_t rows_per_read = std::max<size_t>(1, Image::kIoBufferSize / std::max<size_t>(1, m_row_size_));
+    m_buffer_.resize(std::max(m_buffer_.size(), std::min(rows_per_read, count) * m_row_size_));
+    for (size_t y = 0; y < count; y += rows_per_read) {
+        const size_t rows = std::min(rows_per_read, count - y);
+        m_in_.read(reinterpret_cast<char*>(m_buffer_.data()), static_cast<int64_t>(rows * m_row_size_));
+        for (size_t i = 0; i < rows; ++i) {
+            split_row(m_buffer_.data() + i * m_row_size_, y + i);
+        }
     }
+}
+
+void BmpReader::ReadRows(Image& image, size_t first, size_t count) {
+    ReadBlocks(count, [&](const uint8_t* bgr, size_t y) {
+        SplitBgr(bgr, m_width_, image.GetRow(kRed, first + y), image.GetRow(kGreen, first + y),
+                 image.GetRow(kBlue, first + y));
+    });
+}
 
-    of.close();
+void BmpReader::ReadRows(ComponentImage& image, size_t first, size_t count) {
+    m_planes_.resize(kChannelsCount * m_width_);
+    uint8_t* planes[] = {m_planes_.data(), m_planes_.data() + m_width_, m_planes_.data() + 2 * m_width_};
+    ReadBlocks(count, [&](const uint8_t* bgr, size_t y) {
+        SplitBgr(bgr, m_width_, planes[kRed], planes[kGreen], planes[kBlue]);
+        for (Channel channel : {kRed, kGreen, kBlue}) {
+            BytesToLevels(planes[channel], m_width_, image.GetRow(channel, first + y));
+        }
+    });
+}
+
+void BmpReader::Finish() {
+    m_in_.close();
     std::cout << "File read\n";
 }
 
+BmpWriter::BmpWriter(std::ofstream& out, size_t width, size_t height) : m_out_(out), m_width_(width) {
+    const size_t padding_amount = ((4 - (width * 3) % 4) % 4);
+    m_row_size_ = width * 3 + padding_amount;
+
+    const size_t file_header_size = 14;
+    const size_t information_header_size = 40;
+    const size_t file_size = file_header_size + information_header_size + m_row_size_ * height;
+
+    unsigned char file_header[file_header_size] = {
+        'B',
+        'M',
+        static_cast<unsigned char>(file_size),
+        static_cast<unsigned char>(file_size >> EIGHT),
+        static_cast<unsigned char>(file_size >> SIXTEEN),
+        static_cast<unsigned char>(file_size >> TWENTY_FOUR),
+    };
+
+    file_header[TEN] = file_header_size + information_header_size;
+
+    unsigned char information_header[information_header_size] = {information_header_size,
+                                                                 0,
+                                                                 0,
+                                                                 0,
+                                                                 static_cast<unsigned char>(width),
+                                                                 static_cast<unsigned char>(width >> EIGHT),
+                                                                 static_cast<unsigned char>(width >> SIXTEEN),
+                                                                 static_cast<unsigned char>(width >> TWENTY_FOUR),
+                                                                 static_cast<unsigned char>(height),
+                                                                 static_cast<unsigned char>(height >> EIGHT),
+                                                                 static_cast<unsigned char>(height >> SIXTEEN),
+                                                                 static_cast<unsigned char>(height >> TWENTY_FOUR),
+                                                                 1,
+                                                                 0,
+                                                                 TWENTY_FOUR};
+
+    m_out_.write(reinterpret_cast<char*>(file_header), file_header_size);
+    m_out_.write(reinterpret_cast<char*>(information_header), information_header_size);
+}
+
+template <class MergeRow>
+void BmpWriter::WriteBlocks(size_t count, MergeRow merge_row) {
+    const size_t rows_per_write = std::max<size_t>(1, Image::kIoBufferSize / std::max<size_t>(1, m_row_size_));
+    m_buffer_.resize(std::max(m_buffer_.size(), std::min(rows_per_write, count) * m_row_size_));
+    for (size_t y = 0; y < count; y += rows_per_write) {
+        const size_t rows = std::min(rows_per_write, count - y);
+        for (size_t i = 0; i < rows; ++i) {
+            merge_row(y + i, m_buffer_.data() + i * m_row_size_);
+        }
+        m_out_.write(reinterpret_cast<char*>(m_buffer_.data()), static_cast<int64_t>(rows * m_row_size_));
+    }
+}
+
+void BmpWriter::WriteRows(const Image& image, size_t first, size_t count) {
+    WriteBlocks(count, [&](size_t y, uint8_t* bgr) {
+        MergeBgr(image.GetRow(kRed, first + y), image.GetRow(kGreen, first + y), image.GetRow(kBlue, first + y),
+                 m_width_, bgr);
+    });
+}
+
+void BmpWriter::WriteRows(const ComponentImage& image, size_t first, size_t count) {
+    m_planes_.resize(kChannelsCount * m_width_);
+    uint8_t* planes[] = {m_planes_.data(), m_planes_.data() + m_width_, m_planes_.data() + 2 * m_width_};
+    WriteBlocks(count, [&](size_t y, uint8_t* bgr) {
+        for (Channel channel : {kRed, kGreen, kBlue}) {
+            LevelsToBytes(image.GetRow(channel, first + y), m_width_, planes[channel]);
+        }
+        MergeBgr(planes[kRed], planes[kGreen], planes[kBlue], m_width_, bgr);
+    });
+}
+
+void BmpWriter::Finish() {
+    m_out_.close();
+
+    if (!m_out_.fail()) {
+        std::cout << "File created successfully.\n";
+    } else {
+        std::cerr << "Error creating file. Check if there is enough space on the drive.\n";
+    }
+}
+
 Color Color::operator*(double coeff) const {
     return Color{r * coeff, g * coeff, b * coeff};
 }
@@ -179,10 +466,40 @@ Color Color::operator+(const Color& color) const {
     return Color{r + color.r, g + color.g, b + color.b};
 }
 
-size_t Image::GetHeight() const {
+template <class Value>
+size_t BasicImage<Value>::GetHeight() const {
     return m_height_;
 }
 
-size_t Image::GetWidth() const {
+template <class Value>
+size_t BasicImage<Value>::GetWidth() const {
     return m_width_;
-}
\ No newline at end of file
+}
+
+template <class Value>
+void BasicImage<Value>::Resize(size_t width, size_t height) {
+    m_width_ = width;
+    m_height_ = height;
+    m_stride_ = (width * sizeof(Value) + kRowAlignment - 1) / kRowAlignment * kRowAlignment / sizeof(Value);
+    m_pixels_.resize(kChannelsCount * m_stride_ * height);
+}
+
+template <class Value>
+BasicImage<Value> BasicImage<Value>::Crop(size_t width, size_t height) const {
+    if (width < 0 || height < 0) {
+        throw FilterArgumentException("Crop arguments must be positive integers\n");
+    }
+    height = std::min(height, m_height_);
+    width = std::min(width, m_width_);
+    BasicImage cropped(width, height);
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        for (size_t j = 0; j < height; ++j) {
+            std::copy(GetRow(channel, m_height_ - height + j), GetRow(channel, m_height_ - height + j) + width,
+                      cropped.GetRow(channel, j));
+        }
+    }
+    return cropped;
+}
+
+template class BasicImage<uint8_t>;
+template class BasicImage<uint16_t>;
@@ -1,29 +1,166 @@
 #include "../Headers/MatrixFilter.h"
 
-Image MatrixFilter(const Image& image, const std::vector<std::vector<double>>& matrix, double thresh) {
-    Image new_image = Image(image.GetWidth(), image.GetHeight());
-    for (size_t y = 0; y < image.GetHeight(); ++y) {
-        for (size_t x = 0; x < image.GetWidth(); ++x) {
-            Color new_color;
-            for (int64_t i = -1; i <= 1; ++i) {
-                for (int64_t j = -1; j <= 1; ++j) {
-                    new_color += image.GetColor(x + j, y + i) * matrix[i + 1][j + 1];
-                }
-            }
-            if (thresh == 4) {
-                new_color.r = std::min(1.0, std::max(new_color.r, 0.0));
-                new_color.g = std::min(1.0, std::max(new_color.g, 0.0));
-                new_color.b = std::min(1.0, std::max(new_color.b, 0.0));
-            } else {
-                if (new_color.r > thresh) {
-                    new_color = Color{1, 1, 1};
-                } else {
-                    new_color = Color{0, 0, 0};
-                }
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_FILTER_X86
+#endif
+
+namespace {
+
+// Terms of the sum in the order of the matrix, rows first. Terms with zero coefficients add nothing and are skipped.
+struct Taps {
+    size_t count = 0;
+    size_t row[9];
+    int64_t offset[9];
+    double coefficient[9];
+};
+
+Taps MakeTaps(const std::vector<std::vector<double>>& matrix) {
+    Taps taps;
+    for (size_t i = 0; i < 3; ++i) {
+        for (int64_t j = -1; j <= 1; ++j) {
+            if (matrix[i][j + 1] != 0) {
+                taps.row[taps.count] = i;
+                taps.offset[taps.count] = j;
+                taps.coefficient[taps.count] = matrix[i][j + 1];
+                ++taps.count;
             }
+        }
+    }
+    return taps;
+}
+
+// Columns [first, end) with clamped coordinates, for the borders and the tails of the vectorized loops
+void ConvolveColumns(const double* const rows[3], const Taps& taps, int64_t first, int64_t end, int64_t last,
+                     double* sums) {
+    for (int64_t x = first; x < end; ++x) {
+        double sum = 0;
+        for (size_t tap = 0; tap < taps.count; ++tap) {
+            sum += rows[taps.row[tap]][std::min(last, std::max<int64_t>(0, x + taps.offset[tap]))] *
+                   taps.coefficient[tap];
+        }
+        sums[x] = sum;
+    }
+}
 
-            new_image.SetColor(new_color, x, y);
+// The vectorized loops cover the columns from 1 to width - 2, whose neighbours need no clamping. Every lane adds the
+// same products in the same order as ConvolveColumns, so the sums are exactly equal.
+#ifdef MATRIX_FILTER_X86
+void ConvolveRowSse2(const double* const rows[3], const Taps& taps, size_t width, double* sums) {
+    const int64_t last = static_cast<int64_t>(width) - 1;
+    int64_t x = 1;
+    for (; x + 2 <= last; x += 2) {
+        __m128d sum = _mm_setzero_pd();
+        for (size_t tap = 0; tap < taps.count; ++tap) {
+            __m128d values = _mm_loadu_pd(rows[taps.row[tap]] + x + taps.offset[tap]);
+            sum = _mm_add_pd(sum, _mm_mul_pd(values, _mm_set1_pd(taps.coefficient[tap])));
         }
+        _mm_storeu_pd(sums + x, sum);
     }
-    return new_image;
-}
\ No newline at end of file
+    ConvolveColumns(rows, taps, x, last + 1, last, sums);
+    ConvolveColumns(rows, taps, 0, 1, last, sums);
+}
+
+__attribute__((target("avx2"))) void ConvolveRowAvx2(const double* const rows[3], const Taps& taps, size_t width,
+                                                     double* sums) {
+    const int64_t last = static_cast<int64_t>(width) - 1;
+    int64_t x = 1;
+    for (; x + 4 <= last; x += 4) {
+        __m256d sum = _mm256_setzero_pd();
+        for (size_t tap = 0; tap < taps.count; ++tap) {
+            __m256d values = _mm256_loadu_pd(rows[taps.row[tap]] + x + taps.offset[tap]);
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(values, _mm256_set1_pd(taps.coefficient[tap])));
+        }
+        _mm256_storeu_pd(sums + x, sum);
+    }
+    ConvolveColumns(rows, taps, x, last + 1, last, sums);
+    ConvolveColumns(rows, taps, 0, 1, last, sums);
+}
+
+bool Avx2Supported() {
+    static const bool kSupported = __builtin_cpu_supports("avx2");
+    return kSupported;
+}
+#endif
+
+}  // namespace
+
+void ThresholdRow(const double* sums, size_t width, double thresh, double* row) {
+    size_t x = 0;
+#ifdef MATRIX_FILTER_X86
+    const __m128d threshold = _mm_set1_pd(thresh);
+    const __m128d one = _mm_set1_pd(1);
+    for (; x + 2 <= width; x += 2) {
+        _mm_storeu_pd(row + x, _mm_and_pd(_mm_cmpgt_pd(_mm_loadu_pd(sums + x), threshold), one));
+    }
+#endif
+    for (; x < width; ++x) {
+        row[x] = sums[x] > thresh ? 1 : 0;
+    }
+}
+
+void ConvolveRowScalar(const double* const rows[3], const std::vector<std::vector<double>>& matrix, size_t width,
+                       double* sums) {
+    const int64_t last = static_cast<int64_t>(width) - 1;
+    ConvolveColumns(rows, MakeTaps(matrix), 0, last + 1, last, sums);
+}
+
+void ConvolveRow(const double* const rows[3], const std::vector<std::vector<double>>& matrix, size_t width,
+                 double* sums) {
+    if (width == 0) {
+        return;
+    }
+#ifdef MATRIX_FILTER_X86
+    if (Avx2Supported()) {
+        ConvolveRowAvx2(rows, MakeTaps(matrix), width, sums);
+    } else {
+        ConvolveRowSse2(rows, MakeTaps(matrix), width, sums);
+    }
+#else
+    ConvolveRowScalar(rows, matrix, width, sums);
+#endif
+}
+
+void MatrixFilter(ComponentImage& filtered, const ComponentImage& image, const std::vector<std::vector<double>>& matrix,
+                  ThreadPool& pool, double thresh) {
+    const size_t width = image.GetWidth();
+    const size_t height = image.GetHeight();
+    filtered.Resize(width, height);
+    // Thresholding is done by the red channel and sets all the channels
+    const std::vector<Channel> channels = thresh == 4 ? std::vector{kRed, kGreen, kBlue} : std::vector{kRed};
+    ForEachBand(pool, width, height, [&](size_t begin, size_t end) {
+        // Components of the last three rows, row y is kept at (y % 3) * width
+        std::vector<double> values(3 * width);
+        std::vector<double> sums(width);
+        for (Channel channel : channels) {
+            auto convert = [&](size_t y) {
+                ToComponents(image.GetRow(channel, y), width, values.data() + (y % 3) * width);
+            };
+            for (size_t y = begin == 0 ? 0 : begin - 1; y <= begin; ++y) {
+                convert(y);
+            }
+            for (size_t y = begin; y < end; ++y) {
+                size_t below = y == 0 ? 0 : y - 1;
+                size_t above = std::min(y + 1, height - 1);
+                if (above > y) {
+                    convert(above);
+                }
+                const double* rows[3] = {values.data() + (below % 3) * width, values.data() + (y % 3) * width,
+                                         values.data() + (above % 3) * width};
+                ConvolveRow(rows, matrix, width, sums.data());
+                // ToLevels clamps the sums to [0, 1], which is all the threshold 4 asks for
+                if (thresh != 4) {
+                    ThresholdRow(sums.data(), width, thresh, sums.data());
+                }
+                uint16_t* row = filtered.GetRow(channel, y);
+                ToLevels(sums.data(), width, row);
+                if (thresh != 4) {
+                    std::memcpy(filtered.GetRow(kGreen, y), row, width * sizeof(uint16_t));
+                    std::memcpy(filtered.GetRow(kBlue, y), row, width * sizeof(uint16_t));
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,183 @@
+#include "../Headers/Stream.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace {
+
+// Bytes of the levels of a band of rows read at once. Filters also compute the rows of context around every band
+// they are given, which are thrown away, so bands are at least kContextsPerBand times taller than the largest context.
+const size_t kStreamBandBytes = 4 << 20;
+const size_t kContextsPerBand = 8;
+
+// Copies count rows of the image from row first on to the destination from row destination_first on, as many columns
+// as the destination has
+void CopyRows(const ComponentImage& image, size_t first, size_t count, ComponentImage& destination,
+              size_t destination_first) {
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(destination.GetRow(channel, destination_first + i), image.GetRow(channel, first + i),
+                        destination.GetWidth() * sizeof(uint16_t));
+        }
+    }
+}
+
+// A filter taking the rows of its source and giving the rows of its result, both from the bottom up. Stages keep
+// their buffers from band to band, as they all have about the same size.
+class Stage {
+public:
+    virtual ~Stage() = default;
+
+    // Takes the next rows of the source and returns the next rows of the result which can be computed from the rows
+    // taken so far, possibly none. The rows returned are kept until the next call.
+    virtual const ComponentImage& Push(const ComponentImage& rows) = 0;
+};
+
+// Runs a filter with the given context on the bands of rows of its source it has taken, giving the rows of the band
+// whose context it has
+class FilterStage : public Stage {
+public:
+    using Filter = std::function<void(ComponentImage&, const ComponentImage&)>;
+
+    FilterStage(Filter filter, size_t context, size_t width, size_t height, size_t band_rows)
+        : m_filter_(std::move(filter)),
+          m_context_(context),
+          m_width_(width),
+          m_height_(height),
+          m_band_rows_(band_rows) {
+    }
+
+    const ComponentImage& Push(const ComponentImage& rows) override {
+        m_next_.Resize(m_width_, m_source_.GetHeight() + rows.GetHeight());
+        CopyRows(m_source_, 0, m_source_.GetHeight(), m_next_, 0);
+        CopyRows(rows, 0, rows.GetHeight(), m_next_, m_source_.GetHeight());
+        std::swap(m_source_, m_next_);
+        const size_t source_end = m_source_begin_ + m_source_.GetHeight();
+        // Rows of the result below result_end have context rows of the source on both sides, or the edge of the image
+        const size_t result_end = source_end == m_height_ ? m_height_ : std::max(source_end, m_context_) - m_context_;
+        if (source_end < m_height_ && result_end < m_result_end_ + m_band_rows_) {
+            m_result_.Resize(m_width_, 0);
+            return m_result_;
+        }
+        m_filter_(m_filtered_, m_source_);
+        m_result_.Resize(m_width_, result_end - m_result_end_);
+        CopyRows(m_filtered_, m_result_end_ - m_source_begin_, m_result_.GetHeight(), m_result_, 0);
+        // The rows of the result to come need the source from context rows below them on
+        const size_t kept_begin = std::max(result_end, m_context_) - m_context_;
+        m_next_.Resize(m_width_, source_end - kept_begin);
+        CopyRows(m_source_, kept_begin - m_source_begin_, m_next_.GetHeight(), m_next_, 0);
+        std::swap(m_source_, m_next_);
+        m_source_begin_ = kept_begin;
+        m_result_end_ = result_end;
+        return m_result_;
+    }
+
+private:
+    Filter m_filter_;
+    size_t m_context_;
+    size_t m_width_;
+    size_t m_height_;
+    size_t m_band_rows_;               // rows of the result computed at once, unless the source ends first
+    ComponentImage m_source_{0, 0};    // rows of the source from m_source_begin_ on
+    ComponentImage m_next_{0, 0};      // the next rows of the source being gathered
+    ComponentImage m_filtered_{0, 0};  // the filter applied to m_source_
+    ComponentImage m_result_{0, 0};
+    size_t m_source_begin_ = 0;
+    size_t m_result_end_ = 0;  // rows of the result given so far
+};
+
+// Keeps the left columns of the top rows of the source, as BasicImage::Crop does
+class CropStage : public Stage {
+public:
+    CropStage(size_t width, size_t height, size_t source_height) : m_width_(width), m_first_(source_height - height) {
+    }
+
+    const ComponentImage& Push(const ComponentImage& rows) override {
+        const size_t end = m_source_end_ + rows.GetHeight();
+        const size_t begin = std::min(end, std::max(m_source_end_, m_first_));
+        m_result_.Resize(m_width_, end - begin);
+        CopyRows(rows, begin - m_source_end_, m_result_.GetHeight(), m_result_, 0);
+        m_source_end_ = end;
+        return m_result_;
+    }
+
+private:
+    size_t m_width_;
+    size_t m_first_;  // first row of the source kept
+    size_t m_source_end_ = 0;
+    ComponentImage m_result_{0, 0};
+};
+
+}  // namespace
+
+void StreamFilterChain(std::ifstream& in, std::ofstream& out,
+                       const std::vector<std::pair<std::string, std::vector<std::string_view>>>& filters,
+                       size_t threads_count) {
+    BmpReader reader(in);
+    if (!reader.IsBmp()) {
+        in.close();
+        std::cerr << "The specified path is not a BMP image\n";
+    }
+    // All filters are checked before anything is written
+    std::vector<size_t> contexts;
+    for (const auto& filter : filters) {
+        contexts.push_back(FilterContext(filter));
+    }
+    const size_t band_rows =
+        std::max({kStreamBandBytes / std::max<size_t>(1, kChannelsCount * sizeof(uint16_t) * reader.GetWidth()),
+                  kContextsPerBand * (contexts.empty() ? 0 : *std::max_element(contexts.begin(), contexts.end())),
+                  size_t{1}});
+
+    ThreadPool pool(threads_count);
+    size_t width = reader.GetWidth();
+    size_t height = reader.GetHeight();
+    std::vector<std::unique_ptr<Stage>> stages;
+    // Consecutive per-pixel filters run as one stage, as in FilterChain
+    std::vector<std::pair<std::string, std::vector<std::string_view>>> pixel_filters;
+    auto add_pixel_stage = [&] {
+        if (pixel_filters.empty()) {
+            return;
+        }
+        auto filter = [&pool, pixel_filters](ComponentImage& filtered, const ComponentImage& image) {
+            ApplyPixelFilters(filtered, image, pixel_filters, pool);
+        };
+        stages.push_back(std::make_unique<FilterStage>(filter, 0, width, height, band_rows));
+        pixel_filters.clear();
+    };
+    for (size_t i = 0; i < filters.size(); ++i) {
+        if (MakePixelKernel(ComponentImage(0, 0), filters[i])) {
+            pixel_filters.push_back(filters[i]);
+            continue;
+        }
+        add_pixel_stage();
+        if (filters[i].first == "-crop") {
+            const size_t source_height = height;
+            width = std::min(width, static_cast<size_t>(std::stoi(static_cast<std::string>(filters[i].second[0]))));
+            height = std::min(height, static_cast<size_t>(std::stoi(static_cast<std::string>(filters[i].second[1]))));
+            stages.push_back(std::make_unique<CropStage>(width, height, source_height));
+            continue;
+        }
+        auto filter = [&pool, &filter = filters[i]](ComponentImage& filtered, const ComponentImage& image) {
+            ApplyFilter(filtered, image, filter, pool);
+        };
+        stages.push_back(std::make_unique<FilterStage>(filter, contexts[i], width, height, band_rows));
+    }
+    add_pixel_stage();
+
+    BmpWriter writer(out, width, height);
+    ComponentImage band(0, 0);
+    for (size_t y = 0; y < reader.GetHeight(); y += band_rows) {
+        band.Resize(reader.GetWidth(), std::min(band_rows, reader.GetHeight() - y));
+        reader.ReadRows(band, 0, band.GetHeight());
+        const ComponentImage* rows = &band;
+        for (size_t i = 0; i < stages.size() && rows->GetHeight() != 0; ++i) {
+            rows = &stages[i]->Push(*rows);
+        }
+        writer.WriteRows(*rows, 0, rows->GetHeight());
+    }
+    if (reader.IsBmp()) {
+        reader.Finish();
+    }
+    writer.Finish();
+}
@@ -0,0 +1,117 @@
+#include "../Headers/ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads_count) {
+    if (threads_count == 0) {
+        threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t thread = 0; thread < threads_count; ++thread) {
+        m_queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t thread = 1; thread < threads_count; ++thread) {
+        m_threads_.emplace_back([this, thread] { Work(thread); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex_);
+        m_stop_ = true;
+    }
+    m_work_ready_.notify_all();
+    for (auto& thread : m_threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::ThreadsCount() const {
+    return m_queues_.size();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& function) {
+    grain = std::max<size_t>(1, grain);
+    const size_t ranges_count = (count + grain - 1) / grain;
+    if (ranges_count <= 1 || m_threads_.empty()) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            function(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+    {
+        std::lock_guard lock(m_mutex_);
+        m_function_ = &function;
+        m_remaining_ = ranges_count;
+        m_error_ = nullptr;
+        ++m_generation_;
+    }
+    // Every thread starts with a contiguous share of the ranges, so neighbouring ranges are run by the same thread.
+    // Workers still looking for ranges of the previous call may take these ones right away, which is fine as the
+    // function is already set.
+    for (size_t range = 0; range < ranges_count; ++range) {
+        Queue& queue = *m_queues_[range * ThreadsCount() / ranges_count];
+        std::lock_guard lock(queue.mutex);
+        queue.ranges.push_back({range * grain, std::min(count, (range + 1) * grain)});
+    }
+    m_work_ready_.notify_all();
+    while (RunRange(0)) {
+    }
+    std::unique_lock lock(m_mutex_);
+    m_work_done_.wait(lock, [this] { return m_remaining_ == 0; });
+    m_function_ = nullptr;
+    if (m_error_) {
+        std::rethrow_exception(m_error_);
+    }
+}
+
+// Runs one range from the own queue or stolen from another one, returns false when there are none left
+bool ThreadPool::RunRange(size_t thread) {
+    Range range;
+    bool found = false;
+    for (size_t i = 0; i < ThreadsCount() && !found; ++i) {
+        Queue& queue = *m_queues_[(thread + i) % ThreadsCount()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.ranges.empty()) {
+            if (i == 0) {
+                range = queue.ranges.front();
+                queue.ranges.pop_front();
+            } else {
+                range = queue.ranges.back();
+                queue.ranges.pop_back();
+            }
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    try {
+        (*m_function_)(range.begin, range.end);
+    } catch (...) {
+        std::lock_guard lock(m_mutex_);
+        if (!m_error_) {
+            m_error_ = std::current_exception();
+        }
+    }
+    if (--m_remaining_ == 0) {
+        std::lock_guard lock(m_mutex_);
+        m_work_done_.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::Work(size_t thread) {
+    size_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex_);
+            m_work_ready_.wait(lock, [&] { return m_stop_ || m_generation_ != generation; });
+            if (m_stop_) {
+                return;
+            }
+            generation = m_generation_;
+        }
+        while (RunRange(thread)) {
+        }
+    }
+}
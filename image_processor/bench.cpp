@@ -0,0 +1,313 @@
+#include "Headers/Filters.h"
+#include "Headers/GaussianBlur.h"
+#include "Headers/Image.h"
+#include "Headers/MatrixFilter.h"
+#include "Headers/Stream.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <sys/resource.h>
+
+// Measures how fast images are read from and written to BMP files and how fast filters run on them. The transfers of
+// Image::Read and Image::Export are compared with reading and writing one pixel per stream call and with the transfers
+// of the levels filters work on, fused chains of per-pixel filters with the same filters applied one by one, vectorized
+// convolutions with scalar ones, the exact Gaussian blur with its approximations by boxes, and streaming of files a
+// band at a time with filtering the whole image in memory. The files go to the temporary directory.
+//
+// Usage: bench_image_processor [width height], 8000 x 6000 by default
+
+const size_t kRepeats = 3;
+const size_t kHeaderSize = 54;
+
+Image GenerateImage(size_t width, size_t height, std::mt19937& rng) {
+    Image image(width, height);
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        for (size_t y = 0; y < height; ++y) {
+            uint8_t* row = image.GetRow(channel, y);
+            for (size_t x = 0; x < width; ++x) {
+                row[x] = rng();
+            }
+        }
+    }
+    return image;
+}
+
+// Files of the benchmarks go to the temporary directory
+std::string TempPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+ComponentImage ToComponentImage(const Image& image) {
+    ComponentImage components(image.GetWidth(), image.GetHeight());
+    for (Channel channel : {kRed, kGreen, kBlue}) {
+        for (size_t y = 0; y < image.GetHeight(); ++y) {
+            BytesToLevels(image.GetRow(channel, y), image.GetWidth(), components.GetRow(channel, y));
+        }
+    }
+    return components;
+}
+
+void ReadPerPixel(const std::string& path, Image& image) {
+    std::ifstream in(path, std::ios::binary);
+    in.ignore(kHeaderSize);
+    const size_t padding_amount = (4 - (image.GetWidth() * 3) % 4) % 4;
+    for (size_t y = 0; y < image.GetHeight(); ++y) {
+        for (size_t x = 0; x < image.GetWidth(); ++x) {
+            unsigned char color[3];
+            in.read(reinterpret_cast<char*>(color), 3);
+            image.GetRow(kRed, y)[x] = color[2];
+            image.GetRow(kGreen, y)[x] = color[1];
+            image.GetRow(kBlue, y)[x] = color[0];
+        }
+        in.ignore(static_cast<int64_t>(padding_amount));
+    }
+}
+
+void ExportPerPixel(const std::string& path, const Image& image) {
+    std::ofstream out(path, std::ios::binary);
+    unsigned char header[kHeaderSize] = {};
+    out.write(reinterpret_cast<char*>(header), kHeaderSize);
+    unsigned char bmp_pad[3] = {0, 0, 0};
+    const size_t padding_amount = (4 - (image.GetWidth() * 3) % 4) % 4;
+    for (size_t y = 0; y < image.GetHeight(); ++y) {
+        for (size_t x = 0; x < image.GetWidth(); ++x) {
+            unsigned char color[] = {image.GetRow(kBlue, y)[x], image.GetRow(kGreen, y)[x], image.GetRow(kRed, y)[x]};
+            out.write(reinterpret_cast<char*>(color), 3);
+        }
+        out.write(reinterpret_cast<char*>(bmp_pad), static_cast<int64_t>(padding_amount));
+    }
+}
+
+// Best of kRepeats runs, in millions of units (bytes or pixels) per second
+template <class Function>
+double MillionsPerSecond(double size, Function function) {
+    double best = 0;
+    for (size_t i = 0; i < kRepeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, size / seconds / 1e6);
+    }
+    return best;
+}
+
+void BenchmarkIo(const Image& image) {
+    const std::string path = TempPath("bench_image_processor.bmp");
+    const std::string copy_path = TempPath("bench_image_processor_copy.bmp");
+    // Read and Export report to the console, which would flood the results
+    std::cout.setstate(std::ios::failbit);
+    std::ofstream out(path, std::ios::binary);
+    image.Export(out);
+    std::ifstream size_stream(path, std::ios::binary | std::ios::ate);
+    const size_t file_size = size_stream.tellg();
+
+    Image read(0, 0);
+    double read_speed = MillionsPerSecond(file_size, [&] {
+        std::ifstream in(path, std::ios::binary);
+        read.Read(in);
+    });
+    Image read_per_pixel(image.GetWidth(), image.GetHeight());
+    double read_per_pixel_speed = MillionsPerSecond(file_size, [&] { ReadPerPixel(path, read_per_pixel); });
+    double export_speed = MillionsPerSecond(file_size, [&] {
+        std::ofstream copy(copy_path, std::ios::binary);
+        read.Export(copy);
+    });
+    std::ifstream copy(copy_path, std::ios::binary);
+    Image exported(0, 0);
+    exported.Read(copy);
+    double export_per_pixel_speed = MillionsPerSecond(file_size, [&] { ExportPerPixel(copy_path, image); });
+    // Filters read and export levels, which take a conversion more
+    ComponentImage levels(0, 0);
+    double read_levels_speed = MillionsPerSecond(file_size, [&] {
+        std::ifstream in(path, std::ios::binary);
+        levels.Read(in);
+    });
+    double export_levels_speed = MillionsPerSecond(file_size, [&] {
+        std::ofstream levels_copy(copy_path, std::ios::binary);
+        levels.Export(levels_copy);
+    });
+    std::ifstream levels_copy(copy_path, std::ios::binary);
+    Image exported_levels(0, 0);
+    exported_levels.Read(levels_copy);
+    std::cout.clear();
+
+    auto same_as_image = [&](const Image& other) {
+        bool same = other.GetWidth() == image.GetWidth() && other.GetHeight() == image.GetHeight();
+        for (size_t y = 0; same && y < image.GetHeight(); ++y) {
+            for (Channel channel : {kRed, kGreen, kBlue}) {
+                same = same && std::equal(image.GetRow(channel, y), image.GetRow(channel, y) + image.GetWidth(),
+                                          other.GetRow(channel, y));
+            }
+        }
+        return same;
+    };
+    std::cout << "read bytes=" << file_size << " mb_per_s=" << read_speed
+              << " per_pixel_mb_per_s=" << read_per_pixel_speed << " speedup=" << read_speed / read_per_pixel_speed
+              << std::endl;
+    std::cout << "export bytes=" << file_size << " mb_per_s=" << export_speed
+              << " per_pixel_mb_per_s=" << export_per_pixel_speed
+              << " speedup=" << export_speed / export_per_pixel_speed << (same_as_image(exported) ? "" : " MISMATCH")
+              << std::endl;
+    std::cout << "levels read_mb_per_s=" << read_levels_speed << " export_mb_per_s=" << export_levels_speed
+              << (same_as_image(exported_levels) ? "" : " MISMATCH") << std::endl;
+    std::remove(path.c_str());
+    std::remove(copy_path.c_str());
+}
+
+// Speed of chains of per-pixel filters of growing length in megapixels per second, on one thread
+void BenchmarkPixelFilters(const ComponentImage& image) {
+    using Filters = std::vector<std::pair<std::string, std::vector<std::string_view>>>;
+    // Noise is left out, as generating the noise with rand() takes far longer than blending it
+    const Filters all = {{"-gs", {}}, {"-neg", {}}, {"-neg", {}}, {"-gs", {}}, {"-neg", {}}};
+    const double megapixels = static_cast<double>(image.GetWidth() * image.GetHeight()) / 1e6;
+    ThreadPool pool(1);
+    for (size_t length = 1; length <= all.size(); ++length) {
+        Filters filters(all.begin(), all.begin() + length);
+        double fused_speed = MillionsPerSecond(megapixels * 1e6, [&] {
+            ComponentImage filtered = image;
+            FilterChain(filtered, filters, 1);
+        });
+        double separate_speed = MillionsPerSecond(megapixels * 1e6, [&] {
+            ComponentImage filtered = image;
+            for (const auto& filter : filters) {
+                ComponentImage next(0, 0);
+                ApplyFilter(next, filtered, filter, pool);
+                filtered = std::move(next);
+            }
+        });
+        std::cout << "pixel_filters length=" << length << " fused_mp_per_s=" << fused_speed
+                  << " separate_mp_per_s=" << separate_speed << " speedup=" << fused_speed / separate_speed
+                  << std::endl;
+    }
+}
+
+// Speed of sharpening and edge detection in megapixels per second on one thread, and of the 3x3 convolution alone
+// with and without vectors
+void BenchmarkMatrixFilters(const ComponentImage& image) {
+    const double megapixels = static_cast<double>(image.GetWidth() * image.GetHeight()) / 1e6;
+    ThreadPool pool(1);
+    for (std::string_view name : {"-sharp", "-edge"}) {
+        std::vector<std::string_view> arguments;
+        if (name == "-edge") {
+            arguments.push_back("0.1");
+        }
+        double speed = MillionsPerSecond(megapixels * 1e6, [&] {
+            ComponentImage filtered(0, 0);
+            ApplyFilter(filtered, image, {std::string(name), arguments}, pool);
+        });
+        std::cout << "matrix_filter name=" << name.substr(1) << " mp_per_s=" << speed << std::endl;
+    }
+    const std::vector<std::vector<double>> matrix = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
+    const size_t width = image.GetWidth();
+    std::vector<double> values(3 * width);
+    for (size_t x = 0; x < values.size(); ++x) {
+        values[x] = FromLevel(image.GetRow(kRed, x / width)[x % width]);
+    }
+    const double* rows[3] = {values.data(), values.data() + width, values.data() + 2 * width};
+    std::vector<double> sums(width);
+    double speeds[2];
+    for (bool simd : {false, true}) {
+        speeds[simd] = MillionsPerSecond(megapixels * 1e6, [&] {
+            for (size_t y = 0; y < image.GetHeight(); ++y) {
+                simd ? ConvolveRow(rows, matrix, width, sums.data())
+                     : ConvolveRowScalar(rows, matrix, width, sums.data());
+            }
+        });
+    }
+    std::cout << "convolution scalar_mp_per_s=" << speeds[0] << " simd_mp_per_s=" << speeds[1]
+              << " speedup=" << speeds[1] / speeds[0] << std::endl;
+}
+
+// Speed of the exact Gaussian blur and of cascades of boxes in megapixels per second on one thread, with the bounds
+// of the errors of the cascades
+void BenchmarkBlur(const ComponentImage& image) {
+    const double megapixels = static_cast<double>(image.GetWidth() * image.GetHeight()) / 1e6;
+    ThreadPool pool(1);
+    for (double sigma : {2, 10, 20, 40}) {
+        ComponentImage filtered(0, 0);
+        const std::vector<double> coefficients = GaussianCoefficients(sigma);
+        double exact_speed =
+            MillionsPerSecond(megapixels * 1e6, [&] { BlurExact(filtered, image, coefficients, pool); });
+        std::cout << "blur sigma=" << sigma << " exact_mp_per_s=" << exact_speed;
+        for (size_t boxes : {3, 6}) {
+            BoxCascade cascade = MakeBoxCascade(sigma, boxes);
+            double speed = MillionsPerSecond(megapixels * 1e6, [&] { BlurBoxes(filtered, image, cascade, pool); });
+            std::cout << " boxes" << boxes << "_mp_per_s=" << speed << " boxes" << boxes
+                      << "_max_error=" << cascade.max_error;
+        }
+        std::cout << std::endl;
+    }
+}
+
+long PeakMemoryKb() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Speed of filtering a BMP file into another in megapixels per second on one thread, a band of rows at a time and with
+// the whole image in memory, with the peak memory of the process before and after each. The peak only grows, so this
+// runs before the other benchmarks, and streaming before filtering the whole image.
+void BenchmarkStream(const Image& image) {
+    const std::string path = TempPath("bench_image_processor.bmp");
+    const std::string stream_path = TempPath("bench_image_processor_stream.bmp");
+    const std::string whole_path = TempPath("bench_image_processor_whole.bmp");
+    const std::vector<std::pair<std::string, std::vector<std::string_view>>> filters = {
+        {"-sharp", {}}, {"-blur", {"3"}}, {"-gs", {}}};
+    const double megapixels = static_cast<double>(image.GetWidth() * image.GetHeight()) / 1e6;
+    // Read and Export report to the console, which would flood the results
+    std::cout.setstate(std::ios::failbit);
+    std::ofstream out(path, std::ios::binary);
+    image.Export(out);
+    const long base_peak = PeakMemoryKb();
+    double stream_speed = MillionsPerSecond(megapixels * 1e6, [&] {
+        std::ifstream in(path, std::ios::binary);
+        std::ofstream streamed(stream_path, std::ios::binary);
+        StreamFilterChain(in, streamed, filters, 1);
+    });
+    const long stream_peak = PeakMemoryKb();
+    double whole_speed = MillionsPerSecond(megapixels * 1e6, [&] {
+        std::ifstream in(path, std::ios::binary);
+        ComponentImage whole(0, 0);
+        whole.Read(in);
+        FilterChain(whole, filters, 1);
+        std::ofstream filtered(whole_path, std::ios::binary);
+        whole.Export(filtered);
+    });
+    const long whole_peak = PeakMemoryKb();
+    std::cout.clear();
+
+    std::ifstream streamed(stream_path, std::ios::binary);
+    std::ifstream whole(whole_path, std::ios::binary);
+    bool same = std::equal(std::istreambuf_iterator<char>(streamed), std::istreambuf_iterator<char>(),
+                           std::istreambuf_iterator<char>(whole), std::istreambuf_iterator<char>());
+    std::cout << "stream mp_per_s=" << stream_speed << " whole_mp_per_s=" << whole_speed
+              << " base_peak_rss_kb=" << base_peak << " stream_peak_rss_kb=" << stream_peak
+              << " whole_peak_rss_kb=" << whole_peak << (same ? "" : " MISMATCH") << std::endl;
+    std::remove(path.c_str());
+    std::remove(stream_path.c_str());
+    std::remove(whole_path.c_str());
+}
+
+int main(int argc, char** argv) {
+    size_t width = 8000;
+    size_t height = 6000;
+    if (argc == 3) {
+        width = std::stoull(argv[1]);
+        height = std::stoull(argv[2]);
+    }
+    std::mt19937 rng(0);
+    Image image = GenerateImage(width, height, rng);
+    std::cout << "width=" << width << " height=" << height << std::endl;
+    BenchmarkStream(image);
+    BenchmarkIo(image);
+    const ComponentImage components = ToComponentImage(image);
+    BenchmarkPixelFilters(components);
+    BenchmarkMatrixFilters(components);
+    BenchmarkBlur(components);
+}
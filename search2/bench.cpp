@@ -0,0 +1,227 @@
+#include "search.h"
+#include "codec.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::string GenerateWord(std::mt19937& rng) {
+    std::string word(rng() % 8 + 1, 'a');
+    for (auto& c : word) {
+        c = static_cast<char>('a' + rng() % 6);
+    }
+    return word;
+}
+
+std::string GenerateText(size_t lines, std::mt19937& rng) {
+    std::string text;
+    for (size_t i = 0; i < lines; ++i) {
+        size_t words = rng() % 12 + 1;
+        for (size_t j = 0; j < words; ++j) {
+            text += GenerateWord(rng);
+            text += j + 1 == words ? '\n' : ' ';
+        }
+    }
+    return text;
+}
+
+// Measures index build time for a growing number of threads
+void BenchmarkBuild(const std::string& text) {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+        SearchEngine search_engine;
+        auto start = std::chrono::steady_clock::now();
+        search_engine.BuildIndex(text, threads_count);
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "build threads=" << threads_count << " ms=" << time.count() << std::endl;
+    }
+}
+
+// Measures how many queries per second a single shared SearchEngine serves from a growing number of threads
+void BenchmarkConcurrentSearch(const SearchEngine& search_engine, const std::vector<std::string>& queries) {
+    const auto duration = std::chrono::seconds(1);
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+        std::atomic<bool> stop = false;
+        std::atomic<size_t> total = 0;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threads_count; ++t) {
+            threads.emplace_back([&, t] {
+                size_t done = 0;
+                for (size_t i = t; !stop; i = (i + 1) % queries.size()) {
+                    done += search_engine.Search(queries[i], 10).size() <= 10;
+                }
+                total += done;
+            });
+        }
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::cout << "search threads=" << threads_count << " qps=" << total / duration.count() << std::endl;
+    }
+}
+
+// Compares a burst of queries answered one by one with the same burst answered by SearchBatch
+void BenchmarkBatch(const SearchEngine& search_engine, const std::vector<std::string>& queries) {
+    const std::vector<std::string_view> views(queries.begin(), queries.end());
+    auto start = std::chrono::steady_clock::now();
+    for (auto query : views) {
+        search_engine.Search(query, 10);
+    }
+    auto loop_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    search_engine.SearchBatch(views, 10);
+    auto batch_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "loop qps=" << static_cast<size_t>(views.size() / loop_time)
+              << " batch qps=" << static_cast<size_t>(views.size() / batch_time) << std::endl;
+}
+
+// Compares exhaustive and pruned scoring of the top 10 lines for queries of a growing number of terms
+template <class Scorer>
+void BenchmarkPruning(const std::string& text, const std::string& scorer_name, std::mt19937& rng) {
+    SegmentedIndex index({SearchIndex::Build(text, 1)});
+    for (size_t terms_count : {1, 2, 3, 5, 8, 12, 15}) {
+        std::vector<std::string> queries(200);
+        for (auto& query : queries) {
+            for (size_t i = 0; i < terms_count; ++i) {
+                query += GenerateWord(rng) + " ";
+            }
+        }
+        double times[2];
+        for (bool pruned : {false, true}) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& query : queries) {
+                pruned ? CalculateTopPruned<Scorer>(index, query, 10) : CalculateTop<Scorer>(index, query, 10);
+            }
+            times[pruned] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << "pruning scorer=" << scorer_name << " terms=" << terms_count
+                  << " exhaustive_qps=" << static_cast<size_t>(queries.size() / times[0])
+                  << " pruned_qps=" << static_cast<size_t>(queries.size() / times[1])
+                  << " speedup=" << times[0] / times[1] << std::endl;
+    }
+}
+
+// Compares searches with and without the result cache for queries drawn with heavy-tailed frequencies
+void BenchmarkCache(const std::string& text, const std::vector<std::string>& queries, std::mt19937& rng) {
+    std::vector<double> weights(queries.size());
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = 1.0 / static_cast<double>(i + 1);
+    }
+    std::discrete_distribution<size_t> distribution(weights.begin(), weights.end());
+    std::vector<size_t> stream(20000);
+    for (auto& query : stream) {
+        query = distribution(rng);
+    }
+    for (size_t budget : {0, 1 << 20}) {
+        SearchEngine search_engine({.cache_memory_budget = budget});
+        search_engine.BuildIndex(text);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t query : stream) {
+            search_engine.Search(queries[query], 10);
+        }
+        auto time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        CacheStats stats = search_engine.GetCacheStats();
+        std::cout << "cache budget=" << budget << " qps=" << static_cast<size_t>(stream.size() / time)
+                  << " hits=" << stats.hits << " misses=" << stats.misses << " memory=" << stats.memory << std::endl;
+    }
+}
+
+// Compares bag of words queries with the same words quoted as exact and proximity phrases on an index with positions
+void BenchmarkPhrases(const std::string& text, const std::vector<std::string>& queries) {
+    SearchEngine search_engine({.positions = true});
+    auto start = std::chrono::steady_clock::now();
+    search_engine.BuildIndex(text, 1);
+    auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "phrases build threads=1 ms=" << static_cast<size_t>(time.count()) << std::endl;
+    for (std::string_view syntax : {"", "\"", "\"~3"}) {
+        std::vector<std::string> quoted;
+        for (const auto& query : queries) {
+            quoted.push_back(syntax.empty() ? query : "\"" + query + std::string(syntax));
+        }
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (const auto& query : quoted) {
+            found += search_engine.Search(query, 10).size();
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "phrases syntax=" << (syntax.empty() ? "words" : syntax == "\"" ? "exact" : "proximity")
+                  << " qps=" << static_cast<size_t>(quoted.size() / seconds) << " found=" << found << std::endl;
+    }
+}
+
+// Measures how long a restarted process needs to serve its first query from a saved index
+void BenchmarkLoad(const SearchEngine& search_engine, const std::string& text, const std::string& query) {
+    // In the temporary directory, so that an interrupted run leaves nothing in the working tree
+    const std::string path = (std::filesystem::temp_directory_path() / "bench_search2_index.bin").string();
+    search_engine.SaveIndex(path);
+    auto start = std::chrono::steady_clock::now();
+    SearchEngine loaded;
+    loaded.LoadIndex(path, text);
+    loaded.Search(query, 10);
+    auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "load and first query ms=" << time.count() << std::endl;
+    std::remove(path.c_str());
+}
+
+// Reports the size and decoding speed of posting lists with dense and sparse line numbers
+void BenchmarkCodec(std::mt19937& rng) {
+    const size_t count = 1 << 22;
+    for (uint32_t max_gap : {4u, 64u, 4096u}) {
+        std::vector<uint32_t> lines(count);
+        uint32_t line = 0;
+        for (auto& value : lines) {
+            line += 1 + rng() % max_gap;
+            value = line;
+        }
+        std::vector<uint8_t> encoded(StreamVByteSize(lines.data(), count, 0, true) + kStreamVByteTail);
+        size_t size = EncodeStreamVByte(lines.data(), count, 0, true, encoded.data());
+        std::vector<uint32_t> decoded(count);
+        for (bool simd : {false, true}) {
+            auto start = std::chrono::steady_clock::now();
+            const size_t repeats = 20;
+            for (size_t i = 0; i < repeats; ++i) {
+                if (simd) {
+                    DecodeStreamVByte(encoded.data(), count, 0, true, decoded.data());
+                } else {
+                    DecodeStreamVByteScalar(encoded.data(), count, 0, true, decoded.data());
+                }
+            }
+            auto time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "codec max_gap=" << max_gap << " bytes_per_posting=" << static_cast<double>(size) / count
+                      << (simd ? " simd" : " scalar") << " million_postings_per_s=" << repeats * count / time / 1e6
+                      << (decoded == lines ? "" : " MISMATCH") << std::endl;
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng(0);
+    const std::string text = GenerateText(200000, rng);
+    std::vector<std::string> queries(1000);
+    for (auto& query : queries) {
+        query = GenerateWord(rng) + " " + GenerateWord(rng) + " " + GenerateWord(rng);
+    }
+
+    std::cout << "text_bytes=" << text.size() << std::endl;
+    BenchmarkBuild(text);
+
+    SearchEngine search_engine;
+    search_engine.BuildIndex(text);
+    BenchmarkConcurrentSearch(search_engine, queries);
+    BenchmarkBatch(search_engine, queries);
+    BenchmarkPruning<TfIdfScorer>(text, "tfidf", rng);
+    BenchmarkPruning<Bm25Scorer>(text, "bm25", rng);
+    BenchmarkCache(text, queries, rng);
+    BenchmarkPhrases(text, queries);
+    BenchmarkLoad(search_engine, text, queries[0]);
+    BenchmarkCodec(rng);
+}
@@ -0,0 +1,100 @@
+#include "cache.h"
+#include "tokenizer.h"
+
+#include <functional>
+
+const size_t kCacheShards = 16;
+// Approximate size of the list node, the hash table node and the bucket of an entry
+const size_t kEntryOverhead = 96;
+
+ResultCache::ResultCache(size_t memory_budget)
+    : shard_budget_(memory_budget / kCacheShards), shards_(new Shard[kCacheShards]) {
+}
+
+bool ResultCache::Get(const std::string& key, uint64_t generation, std::vector<size_t>& lines) {
+    Shard& shard = GetShard(key);
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.positions.find(key);
+        if (it != shard.positions.end()) {
+            if (it->second->generation == generation) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                lines = it->second->lines;
+                ++hits_;
+                return true;
+            }
+            Erase(shard, it->second);
+        }
+    }
+    ++misses_;
+    return false;
+}
+
+void ResultCache::Put(std::string key, uint64_t generation, std::vector<size_t> lines) {
+    Shard& shard = GetShard(key);
+    Entry entry = {std::move(key), generation, std::move(lines)};
+    size_t memory = EntryMemory(entry);
+    if (memory > shard_budget_) {
+        return;
+    }
+    std::lock_guard lock(shard.mutex);
+    if (auto it = shard.positions.find(entry.key); it != shard.positions.end()) {
+        Erase(shard, it->second);
+    }
+    while (shard.memory + memory > shard_budget_) {
+        Erase(shard, std::prev(shard.entries.end()));
+    }
+    shard.entries.push_front(std::move(entry));
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.memory += memory;
+}
+
+void ResultCache::Clear() {
+    for (size_t i = 0; i < kCacheShards; ++i) {
+        std::lock_guard lock(shards_[i].mutex);
+        shards_[i].positions.clear();
+        shards_[i].entries.clear();
+        shards_[i].memory = 0;
+    }
+}
+
+CacheStats ResultCache::Stats() const {
+    CacheStats stats = {hits_, misses_, 0, 0};
+    for (size_t i = 0; i < kCacheShards; ++i) {
+        std::lock_guard lock(shards_[i].mutex);
+        stats.entries += shards_[i].entries.size();
+        stats.memory += shards_[i].memory;
+    }
+    return stats;
+}
+
+size_t ResultCache::EntryMemory(const Entry& entry) {
+    return sizeof(Entry) + kEntryOverhead + entry.key.size() + entry.lines.size() * sizeof(size_t);
+}
+
+ResultCache::Shard& ResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>()(key) % kCacheShards];
+}
+
+void ResultCache::Erase(Shard& shard, std::list<Entry>::iterator it) {
+    shard.memory -= EntryMemory(*it);
+    shard.positions.erase(it->key);
+    shard.entries.erase(it);
+}
+
+std::string CacheKey(std::span<const std::string_view> words, std::span<const Phrase> phrases, size_t results_count) {
+    std::string key = std::to_string(results_count);
+    for (std::string_view word : words) {
+        key += ' ';
+        AppendFoldedWord(word, key);
+    }
+    for (const Phrase& phrase : phrases) {
+        key += " \"";
+        for (std::string_view word : phrase.words) {
+            key += ' ';
+            AppendFoldedWord(word, key);
+        }
+        key += phrase.slop ? "\"~" + std::to_string(*phrase.slop) : "\"";
+    }
+    return key;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "phrase.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t memory;  // bytes taken by the entries, approximately
+};
+
+// LRU cache of search results: numbers of the found lines keyed by the normalized query. Entries are tagged with
+// the generation of the index they were computed on and only returned for the same generation. The cache is split
+// into shards with their own locks and equal parts of the memory budget, so concurrent searches rarely wait.
+class ResultCache {
+public:
+    explicit ResultCache(size_t memory_budget);
+
+    bool Get(const std::string& key, uint64_t generation, std::vector<size_t>& lines);
+    void Put(std::string key, uint64_t generation, std::vector<size_t> lines);
+    void Clear();
+    CacheStats Stats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<size_t> lines;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;  // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions;  // keys point into entries
+        size_t memory = 0;
+    };
+
+    static size_t EntryMemory(const Entry& entry);
+    Shard& GetShard(const std::string& key);
+    void Erase(Shard& shard, std::list<Entry>::iterator it);
+
+    size_t shard_budget_;
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+};
+
+// Key of a query: its distinct lowercase words in sorted order, its phrases and the number of results
+std::string CacheKey(std::span<const std::string_view> words, std::span<const Phrase> phrases, size_t results_count);
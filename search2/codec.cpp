@@ -0,0 +1,134 @@
+#include "codec.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STREAM_VBYTE_X86
+#endif
+
+// Values are stored in little-endian order, as on every platform the index is built for
+size_t ValueBytes(uint32_t value) {
+    if (value < (1u << 8)) {
+        return 1;
+    }
+    if (value < (1u << 16)) {
+        return 2;
+    }
+    return value < (1u << 24) ? 3 : 4;
+}
+
+size_t ControlBytes(size_t count) {
+    return (count + 3) / 4;
+}
+
+struct ShuffleTables {
+    alignas(16) uint8_t shuffle[256][16];  // moves the data bytes of a group into four 32-bit lanes
+    uint8_t length[256];                   // data bytes of a group
+};
+
+constexpr ShuffleTables MakeShuffleTables() {
+    ShuffleTables tables = {};
+    for (size_t control = 0; control < 256; ++control) {
+        uint8_t position = 0;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            size_t bytes = ((control >> (2 * lane)) & 3) + 1;
+            for (size_t byte = 0; byte < 4; ++byte) {
+                tables.shuffle[control][4 * lane + byte] = byte < bytes ? position++ : 0x80;
+            }
+        }
+        tables.length[control] = position;
+    }
+    return tables;
+}
+
+const ShuffleTables kShuffleTables = MakeShuffleTables();
+
+size_t StreamVByteSize(const uint32_t* values, size_t count, uint32_t base, bool delta) {
+    size_t size = ControlBytes(count);
+    uint32_t previous = base;
+    for (size_t i = 0; i < count; ++i) {
+        size += ValueBytes(delta ? values[i] - previous : values[i]);
+        previous = values[i];
+    }
+    return size;
+}
+
+size_t EncodeStreamVByte(const uint32_t* values, size_t count, uint32_t base, bool delta, uint8_t* out) {
+    uint8_t* control = out;
+    uint8_t* data = out + ControlBytes(count);
+    std::memset(control, 0, ControlBytes(count));
+    uint32_t previous = base;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t value = delta ? values[i] - previous : values[i];
+        previous = values[i];
+        size_t bytes = ValueBytes(value);
+        control[i / 4] |= static_cast<uint8_t>((bytes - 1) << (i % 4 * 2));
+        std::memcpy(data, &value, bytes);
+        data += bytes;
+    }
+    return data - out;
+}
+
+// Decodes values [begin, count) one by one. Returns the end of their data.
+const uint8_t* DecodeValues(const uint8_t* control, const uint8_t* data, size_t begin, size_t count,
+                            uint32_t previous, bool delta, uint32_t* out) {
+    for (size_t i = begin; i < count; ++i) {
+        size_t bytes = ((control[i / 4] >> (i % 4 * 2)) & 3) + 1;
+        uint32_t value = 0;
+        std::memcpy(&value, data, bytes);
+        data += bytes;
+        previous = delta ? previous + value : value;
+        out[i] = previous;
+    }
+    return data;
+}
+
+size_t DecodeStreamVByteScalar(const uint8_t* in, size_t count, uint32_t base, bool delta, uint32_t* out) {
+    return DecodeValues(in, in + ControlBytes(count), 0, count, base, delta, out) - in;
+}
+
+#ifdef STREAM_VBYTE_X86
+__attribute__((target("ssse3"))) size_t DecodeStreamVByteSsse3(const uint8_t* in, size_t count, uint32_t base,
+                                                                bool delta, uint32_t* out) {
+    const uint8_t* control = in;
+    const uint8_t* data = in + ControlBytes(count);
+    const size_t groups = count / 4;
+    __m128i previous = _mm_set1_epi32(static_cast<int>(base));
+    for (size_t group = 0; group < groups; ++group) {
+        uint8_t group_control = control[group];
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(kShuffleTables.shuffle[group_control]));
+        __m128i values = _mm_shuffle_epi8(bytes, mask);
+        if (delta) {
+            // Prefix sum of the four lanes plus the last value of the previous group
+            values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+            values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+            values = _mm_add_epi32(values, previous);
+            previous = _mm_shuffle_epi32(values, 0xFF);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * group), values);
+        data += kShuffleTables.length[group_control];
+    }
+    uint32_t last = groups == 0 ? base : out[4 * groups - 1];
+    return DecodeValues(control, data, 4 * groups, count, last, delta, out) - in;
+}
+#endif
+
+bool StreamVByteSimdSupported() {
+#ifdef STREAM_VBYTE_X86
+    static const bool kSupported = __builtin_cpu_supports("ssse3");
+    return kSupported;
+#else
+    return false;
+#endif
+}
+
+size_t DecodeStreamVByte(const uint8_t* in, size_t count, uint32_t base, bool delta, uint32_t* out) {
+#ifdef STREAM_VBYTE_X86
+    if (StreamVByteSimdSupported()) {
+        return DecodeStreamVByteSsse3(in, count, base, delta, out);
+    }
+#endif
+    return DecodeStreamVByteScalar(in, count, base, delta, out);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Stream VByte codec for posting lists. Values are split into groups of four, and the byte lengths of a group are
+// packed into one control byte stored apart from the data bytes, so a whole group can be decoded with a single
+// shuffle. With delta set, differences between consecutive values (the first one taken relative to base) are
+// encoded instead of the values, which must be non-decreasing.
+//
+// The decoders may read up to kStreamVByteTail bytes past the end of the encoded data.
+
+const size_t kStreamVByteTail = 16;
+
+size_t StreamVByteSize(const uint32_t* values, size_t count, uint32_t base, bool delta);
+size_t EncodeStreamVByte(const uint32_t* values, size_t count, uint32_t base, bool delta, uint8_t* out);
+
+// Decodes with SIMD instructions when the processor supports them. All decoders return the number of bytes read.
+size_t DecodeStreamVByte(const uint8_t* in, size_t count, uint32_t base, bool delta, uint32_t* out);
+size_t DecodeStreamVByteScalar(const uint8_t* in, size_t count, uint32_t base, bool delta, uint32_t* out);
+bool StreamVByteSimdSupported();
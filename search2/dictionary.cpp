@@ -0,0 +1,77 @@
+#include "dictionary.h"
+#include "tokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+
+const uint64_t kCaseBits = 0x2020202020202020ull;
+const uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ull;
+
+// Mixes the word eight bytes at a time. Setting the case bit of every byte lowercases letters.
+uint64_t HashWord(std::string_view word) {
+    uint64_t hash = word.size() * kHashMultiplier;
+    for (size_t i = 0; i < word.size(); i += sizeof(uint64_t)) {
+        size_t bytes = std::min(sizeof(uint64_t), word.size() - i);
+        uint64_t chunk = 0;
+        std::memcpy(&chunk, word.data() + i, bytes);
+        chunk |= kCaseBits >> (8 * (sizeof(uint64_t) - bytes));
+        hash = (hash ^ chunk) * kHashMultiplier;
+        hash ^= hash >> 29;
+    }
+    return hash ^ (hash >> 32);
+}
+
+bool EqualsFolded(std::string_view term, std::string_view word) {
+    if (term.size() != word.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < word.size(); ++i) {
+        if (term[i] != (word[i] | 0x20)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void InsertTermSlot(std::span<uint32_t> slots, uint64_t hash, uint32_t id) {
+    const size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != kNoTerm) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = id;
+}
+
+uint32_t TermDictionary::Intern(std::string_view word) {
+    uint32_t id = Find(word);
+    if (id != kNoTerm) {
+        return id;
+    }
+    if (2 * (Size() + 1) > slots_.size()) {
+        Grow();
+    }
+    id = static_cast<uint32_t>(Size());
+    AppendFoldedWord(word, arena_);
+    offsets_.push_back(arena_.size());
+    InsertTermSlot(slots_, HashWord(word), id);
+    return id;
+}
+
+uint32_t TermDictionary::Find(std::string_view word) const {
+    return FindTermSlot(slots_, word, [this](uint32_t id) { return GetTerm(id); });
+}
+
+std::string_view TermDictionary::GetTerm(uint32_t id) const {
+    return std::string_view(arena_).substr(offsets_[id], offsets_[id + 1] - offsets_[id]);
+}
+
+size_t TermDictionary::Size() const {
+    return offsets_.size() - 1;
+}
+
+void TermDictionary::Grow() {
+    slots_.assign(std::max<size_t>(16, 2 * slots_.size()), kNoTerm);
+    for (uint32_t id = 0; id < Size(); ++id) {
+        InsertTermSlot(slots_, HashWord(GetTerm(id)), id);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+const uint32_t kNoTerm = UINT32_MAX;
+
+// Hash of the lowercase form of a word made of ASCII letters. It is a part of the index format.
+uint64_t HashWord(std::string_view word);
+// Checks that a lowercase term is the word in any case
+bool EqualsFolded(std::string_view term, std::string_view word);
+
+// Open-addressing table of term ids with linear probing. Its size is a power of two, empty slots hold kNoTerm.
+void InsertTermSlot(std::span<uint32_t> slots, uint64_t hash, uint32_t id);
+
+template <class GetTerm>
+uint32_t FindTermSlot(std::span<const uint32_t> slots, std::string_view word, GetTerm&& get_term) {
+    if (slots.empty()) {
+        return kNoTerm;
+    }
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = HashWord(word) & mask;; slot = (slot + 1) & mask) {
+        if (slots[slot] == kNoTerm || EqualsFolded(get_term(slots[slot]), word)) {
+            return slots[slot];
+        }
+    }
+}
+
+// Interns words into dense ids in order of first appearance. Terms are stored lowercase in one byte arena and
+// found through a table of ids, so looking a word up does not allocate.
+class TermDictionary {
+public:
+    uint32_t Intern(std::string_view word);
+    uint32_t Find(std::string_view word) const;
+    std::string_view GetTerm(uint32_t id) const;
+    size_t Size() const;
+
+private:
+    void Grow();
+
+    std::string arena_;
+    std::vector<uint64_t> offsets_ = {0};  // term i occupies arena_[offsets_[i], offsets_[i + 1])
+    std::vector<uint32_t> slots_;
+};
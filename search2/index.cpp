@@ -0,0 +1,802 @@
+#include "index.h"
+#include "codec.h"
+#include "tokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum IndexSection {
+    kTermsSection,
+    kTermSlotsSection,
+    kNamesSection,
+    kBlocksSection,
+    kPostingsSection,
+    kLineBlocksSection,
+    kLineBeginsSection,
+    kLineLengthsSection,
+    kLongLinesSection,
+    kLineNormsSection,
+    kSectionsCount
+};
+
+struct Section {
+    uint64_t offset;  // from the beginning of the buffer, multiple of 8
+    uint64_t size;    // in bytes
+};
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections_count;
+    uint64_t text_size;
+    uint64_t text_fingerprint;
+    uint64_t lines_with_words;
+    uint64_t words_count;
+    uint64_t positions;  // nonzero if postings blocks store word positions
+    Section sections[kSectionsCount];
+};
+
+const char kIndexMagic[8] = {'S', 'E', 'A', 'R', 'C', 'H', '2', '\0'};
+const uint32_t kIndexVersion = 7;
+const size_t kFingerprintBytes = 1 << 12;
+const size_t kMinShardSize = 1 << 16;
+const size_t kShardsPerThread = 4;
+
+LineTable::LineTable(std::span<const uint64_t> block_begin, std::span<const uint32_t> begin,
+                     std::span<const uint32_t> length, std::span<const LongLine> long_lines)
+    : block_begin_(block_begin), begin_(begin), length_(length), long_lines_(long_lines) {
+}
+
+std::pair<size_t, size_t> LineTable::Get(size_t line) const {
+    if (begin_[line] == kLongLine) {
+        auto it = std::lower_bound(long_lines_.begin(), long_lines_.end(), line,
+                                   [](const LongLine& long_line, size_t line) { return long_line.line < line; });
+        return {it->begin, it->end};
+    }
+    size_t begin = block_begin_[line / kBlockSize] + begin_[line];
+    return {begin, begin + length_[line]};
+}
+
+size_t LineTable::Size() const {
+    return begin_.size();
+}
+
+std::span<const uint64_t> LineTable::BlockBegins() const {
+    return block_begin_;
+}
+
+std::span<const uint32_t> LineTable::Begins() const {
+    return begin_;
+}
+
+std::span<const uint32_t> LineTable::Lengths() const {
+    return length_;
+}
+
+std::span<const LongLine> LineTable::LongLines() const {
+    return long_lines_;
+}
+
+void LineTableBuilder::Add(size_t begin, size_t end) {
+    size_t line = begin_.size();
+    if (line % LineTable::kBlockSize == 0) {
+        block_begin_.push_back(begin);
+    }
+    size_t offset = begin - block_begin_.back();
+    if (offset >= LineTable::kLongLine || end - begin >= LineTable::kLongLine) {
+        long_lines_.push_back({line, begin, end});
+        begin_.push_back(LineTable::kLongLine);
+        length_.push_back(LineTable::kLongLine);
+        return;
+    }
+    begin_.push_back(static_cast<uint32_t>(offset));
+    length_.push_back(static_cast<uint32_t>(end - begin));
+}
+
+size_t LineTableBuilder::Size() const {
+    return begin_.size();
+}
+
+LineTable LineTableBuilder::View() const {
+    return LineTable(block_begin_, begin_, length_, long_lines_);
+}
+
+// FNV-1a hash of the size and both ends of the text, cheap enough to check on every load
+uint64_t TextFingerprint(std::string_view text) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](std::string_view part) {
+        for (char c : part) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+    };
+    add(text.substr(0, kFingerprintBytes));
+    add(text.substr(text.size() - std::min(text.size(), kFingerprintBytes)));
+    return hash ^ text.size();
+}
+
+struct Posting {
+    uint32_t line;
+    uint32_t count;
+};
+
+struct IndexShard {
+    LineTableBuilder lines;
+    std::vector<float> line_norms;
+    TermDictionary terms;
+    std::vector<std::vector<Posting>> postings;  // by term id
+    // By term id, if positions are indexed: positions of the term in the lines of its postings, one after another
+    std::vector<std::vector<uint32_t>> positions;
+    bool with_positions = false;
+    size_t lines_with_words = 0;
+    uint64_t words_count = 0;
+};
+
+// Indexes text[begin, end), which must start at the beginning of a line. Line numbers are local to the shard.
+IndexShard BuildShard(std::string_view text, size_t begin, size_t end, bool with_positions) {
+    IndexShard shard;
+    shard.with_positions = with_positions;
+    std::vector<uint32_t> line_counts;  // occurrences of every term in the current line
+    std::vector<uint32_t> line_terms;   // distinct terms of the current line
+    size_t line = 0;
+    size_t line_begin = begin;
+    size_t length = 0;
+    auto end_line = [&](size_t position) {
+        if (position > line_begin) {
+            shard.lines.Add(line_begin, position);
+            shard.line_norms.push_back(static_cast<float>(length));
+            for (uint32_t id : line_terms) {
+                shard.postings[id].push_back({static_cast<uint32_t>(line), line_counts[id]});
+                line_counts[id] = 0;
+            }
+            shard.lines_with_words += length != 0;
+            shard.words_count += length;
+            line_terms.clear();
+            ++line;
+            length = 0;
+        }
+        line_begin = position + 1;
+    };
+    auto on_word = [&](size_t word_begin, size_t word_end) {
+        uint32_t id = shard.terms.Intern(text.substr(begin + word_begin, word_end - word_begin));
+        if (id == shard.postings.size()) {
+            shard.postings.emplace_back();
+            line_counts.push_back(0);
+            if (with_positions) {
+                shard.positions.emplace_back();
+            }
+        }
+        if (with_positions) {
+            shard.positions[id].push_back(static_cast<uint32_t>(length));
+        }
+        if (line_counts[id]++ == 0) {
+            line_terms.push_back(id);
+        }
+        ++length;
+    };
+    Tokenize(text.substr(begin, end - begin), on_word, [&](size_t position) { end_line(begin + position); });
+    end_line(end);
+    return shard;
+}
+
+// Splits the text into at most shards_count pieces ending right after a line break
+std::vector<size_t> SplitIntoShards(std::string_view text, size_t begin, size_t end, size_t shards_count) {
+    std::vector<size_t> bounds = {begin};
+    for (size_t i = 1; i < shards_count; ++i) {
+        size_t bound = text.find('\n', std::max(bounds.back(), begin + (end - begin) / shards_count * i));
+        if (bound >= end) {
+            break;
+        }
+        bounds.push_back(bound + 1);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+// Runs task(0), ..., task(tasks_count - 1) on threads_count threads
+void RunInParallel(size_t tasks_count, size_t threads_count, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next_task = 0;
+    auto worker = [&] {
+        for (size_t i = next_task++; i < tasks_count; i = next_task++) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(threads_count, tasks_count); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Appends the shard to the index. Shards must be merged in text order, which makes the result identical to
+// indexing the whole text at once, term ids included.
+void MergeShard(IndexShard& shard, IndexShard& index) {
+    size_t line_offset = index.lines.Size();
+    if (line_offset + shard.lines.Size() > UINT32_MAX) {
+        throw std::length_error("Too many lines to index");
+    }
+    LineTable shard_lines = shard.lines.View();
+    for (size_t line = 0; line < shard_lines.Size(); ++line) {
+        auto [begin, end] = shard_lines.Get(line);
+        index.lines.Add(begin, end);
+    }
+    index.line_norms.insert(index.line_norms.end(), shard.line_norms.begin(), shard.line_norms.end());
+    index.lines_with_words += shard.lines_with_words;
+    index.words_count += shard.words_count;
+    // Postings of a shard after lines without words still need the offset
+    if (index.terms.Size() == 0 && line_offset == 0) {
+        index.terms = std::move(shard.terms);
+        index.postings = std::move(shard.postings);
+        index.positions = std::move(shard.positions);
+        return;
+    }
+    for (uint32_t id = 0; id < shard.terms.Size(); ++id) {
+        uint32_t index_id = index.terms.Intern(shard.terms.GetTerm(id));
+        if (index_id == index.postings.size()) {
+            index.postings.emplace_back();
+            if (index.with_positions) {
+                index.positions.emplace_back();
+            }
+        }
+        std::vector<Posting>& postings = index.postings[index_id];
+        for (const auto& posting : shard.postings[id]) {
+            postings.push_back({static_cast<uint32_t>(posting.line + line_offset), posting.count});
+        }
+        // Assigning {} would keep the capacity
+        shard.postings[id] = std::vector<Posting>();
+        if (index.with_positions) {
+            index.positions[index_id].insert(index.positions[index_id].end(), shard.positions[id].begin(),
+                                             shard.positions[id].end());
+            shard.positions[id] = std::vector<uint32_t>();
+        }
+    }
+}
+
+size_t AlignSection(size_t size) {
+    return (size + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+}
+
+template <class T>
+void WriteSection(char* data, const Section& section, std::span<const T> values) {
+    if (!values.empty()) {
+        std::memcpy(data + section.offset, values.data(), values.size_bytes());
+    }
+}
+
+template <class T>
+std::span<const T> ReadSection(const char* data, const Section& section) {
+    return {reinterpret_cast<const T*>(data + section.offset), section.size / sizeof(T)};
+}
+
+// Encodes postings[begin, end) as one block, followed by their word positions if positions are not null. Positions
+// are stored as differences from the previous position in the same line. Returns the size of the block, and only
+// computes it if out is null.
+size_t EncodePostingsBlock(const std::vector<Posting>& postings, size_t begin, size_t end,
+                           const uint32_t* positions, uint8_t* out) {
+    uint32_t lines[kPostingsBlockSize];
+    uint32_t counts[kPostingsBlockSize];
+    size_t positions_count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        lines[i - begin] = postings[i].line;
+        counts[i - begin] = postings[i].count;
+        positions_count += postings[i].count;
+    }
+    uint32_t base = begin == 0 ? 0 : postings[begin - 1].line;
+    std::vector<uint32_t> gaps;
+    if (positions) {
+        gaps.resize(positions_count);
+        for (size_t i = begin, position = 0; i < end; ++i) {
+            for (uint32_t j = 0; j < postings[i].count; ++j, ++position) {
+                gaps[position] = positions[position] - (j == 0 ? 0 : positions[position - 1]);
+            }
+        }
+    }
+    if (!out) {
+        return StreamVByteSize(lines, end - begin, base, true) + StreamVByteSize(counts, end - begin, 0, false) +
+               StreamVByteSize(gaps.data(), gaps.size(), 0, false);
+    }
+    size_t size = EncodeStreamVByte(lines, end - begin, base, true, out);
+    size += EncodeStreamVByte(counts, end - begin, 0, false, out + size);
+    return size + EncodeStreamVByte(gaps.data(), gaps.size(), 0, false, out + size);
+}
+
+// Lays the index out in a single buffer, releasing the postings of every term as soon as they are encoded. If
+// load_term is given, the postings of the index are empty and it fills those of a term each time they are encoded.
+std::vector<uint64_t> SerializeIndex(IndexShard& index, std::string_view text,
+                                     const std::function<void(uint32_t)>& load_term = nullptr) {
+    const size_t terms_count = index.terms.Size();
+    const size_t slots_count = std::bit_ceil(2 * terms_count);
+    size_t names_size = 0;
+    size_t blocks_count = 0;
+    size_t postings_size = kStreamVByteTail;
+    // Positions of postings[begin, end) of a term whose earlier postings have the given number of positions
+    auto block_positions = [&index](uint32_t id, size_t begin, size_t end, size_t& position) -> const uint32_t* {
+        if (!index.with_positions) {
+            return nullptr;
+        }
+        const uint32_t* positions = index.positions[id].data() + position;
+        for (size_t i = begin; i < end; ++i) {
+            position += index.postings[id][i].count;
+        }
+        return positions;
+    };
+    auto release_term = [&index](uint32_t id) {
+        // Assigning {} would keep the capacity
+        index.postings[id] = std::vector<Posting>();
+        if (index.with_positions) {
+            index.positions[id] = std::vector<uint32_t>();
+        }
+    };
+    for (uint32_t id = 0; id < terms_count; ++id) {
+        if (load_term) {
+            load_term(id);
+        }
+        const std::vector<Posting>& term_postings = index.postings[id];
+        names_size += index.terms.GetTerm(id).size();
+        size_t position = 0;
+        for (size_t begin = 0; begin < term_postings.size(); begin += kPostingsBlockSize) {
+            size_t end = std::min(begin + kPostingsBlockSize, term_postings.size());
+            const uint32_t* positions = block_positions(id, begin, end, position);
+            postings_size += EncodePostingsBlock(term_postings, begin, end, positions, nullptr);
+            ++blocks_count;
+        }
+        if (load_term) {
+            release_term(id);
+        }
+    }
+
+    IndexHeader header = {};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.sections_count = kSectionsCount;
+    header.text_size = text.size();
+    header.text_fingerprint = TextFingerprint(text);
+    header.lines_with_words = index.lines_with_words;
+    header.words_count = index.words_count;
+    header.positions = index.with_positions;
+    LineTable lines = index.lines.View();
+    const size_t sizes[kSectionsCount] = {terms_count * sizeof(TermInfo),
+                                          slots_count * sizeof(uint32_t),
+                                          names_size,
+                                          blocks_count * sizeof(PostingsBlock),
+                                          postings_size,
+                                          lines.BlockBegins().size_bytes(),
+                                          lines.Begins().size_bytes(),
+                                          lines.Lengths().size_bytes(),
+                                          lines.LongLines().size_bytes(),
+                                          index.line_norms.size() * sizeof(float)};
+    size_t offset = AlignSection(sizeof(IndexHeader));
+    for (size_t i = 0; i < kSectionsCount; ++i) {
+        header.sections[i] = {offset, sizes[i]};
+        offset += AlignSection(sizes[i]);
+    }
+
+    std::vector<uint64_t> buffer(offset / sizeof(uint64_t));
+    char* data = reinterpret_cast<char*>(buffer.data());
+    std::memcpy(data, &header, sizeof(header));
+    WriteSection(data, header.sections[kLineBlocksSection], lines.BlockBegins());
+    WriteSection(data, header.sections[kLineBeginsSection], lines.Begins());
+    WriteSection(data, header.sections[kLineLengthsSection], lines.Lengths());
+    WriteSection(data, header.sections[kLongLinesSection], lines.LongLines());
+    WriteSection(data, header.sections[kLineNormsSection], std::span<const float>(index.line_norms));
+    auto* term_infos = reinterpret_cast<TermInfo*>(data + header.sections[kTermsSection].offset);
+    std::span<uint32_t> slots(reinterpret_cast<uint32_t*>(data + header.sections[kTermSlotsSection].offset),
+                              slots_count);
+    std::fill(slots.begin(), slots.end(), kNoTerm);
+    char* names = data + header.sections[kNamesSection].offset;
+    auto* blocks = reinterpret_cast<PostingsBlock*>(data + header.sections[kBlocksSection].offset);
+    auto* postings = reinterpret_cast<uint8_t*>(data + header.sections[kPostingsSection].offset);
+    size_t name_offset = 0;
+    size_t block = 0;
+    size_t postings_offset = 0;
+    for (uint32_t id = 0; id < terms_count; ++id) {
+        if (load_term) {
+            load_term(id);
+        }
+        std::string_view name = index.terms.GetTerm(id);
+        std::vector<Posting>& term_postings = index.postings[id];
+        size_t term_blocks = (term_postings.size() + kPostingsBlockSize - 1) / kPostingsBlockSize;
+        double max_tf = 0;
+        size_t position = 0;
+        for (size_t begin = 0; begin < term_postings.size(); begin += kPostingsBlockSize) {
+            size_t end = std::min(begin + kPostingsBlockSize, term_postings.size());
+            // Frequencies are computed exactly as at search time, so that the bounds hold without rounding errors
+            double block_max_tf = 0;
+            for (size_t i = begin; i < end; ++i) {
+                double tf = static_cast<double>(term_postings[i].count) /
+                            static_cast<double>(index.line_norms[term_postings[i].line]);
+                block_max_tf = std::max(block_max_tf, tf);
+            }
+            max_tf = std::max(max_tf, block_max_tf);
+            blocks[block + begin / kPostingsBlockSize] = {postings_offset, term_postings[end - 1].line,
+                                                          static_cast<uint32_t>(end - begin), block_max_tf};
+            const uint32_t* positions = block_positions(id, begin, end, position);
+            postings_offset += EncodePostingsBlock(term_postings, begin, end, positions, postings + postings_offset);
+        }
+        term_infos[id] = {name_offset,
+                          block,
+                          term_postings.size(),
+                          max_tf,
+                          static_cast<uint32_t>(name.size()),
+                          static_cast<uint32_t>(term_blocks)};
+        block += term_blocks;
+        InsertTermSlot(slots, HashWord(name), id);
+        std::memcpy(names + name_offset, name.data(), name.size());
+        name_offset += name.size();
+        release_term(id);
+    }
+    return buffer;
+}
+
+SearchIndex::SearchIndex(std::string_view text, std::shared_ptr<const void> storage, size_t size)
+    : text_(text), storage_(std::move(storage)), size_(size) {
+    const char* data = static_cast<const char*>(storage_.get());
+    header_ = reinterpret_cast<const IndexHeader*>(data);
+    if (size_ < sizeof(IndexHeader) || std::memcmp(header_->magic, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+        throw std::runtime_error("Not a search index");
+    }
+    if (header_->version != kIndexVersion || header_->sections_count != kSectionsCount) {
+        throw std::runtime_error("Unsupported search index version");
+    }
+    if (header_->text_size != text.size() || header_->text_fingerprint != TextFingerprint(text)) {
+        throw std::runtime_error("Search index was built from a different text");
+    }
+    for (const Section& section : header_->sections) {
+        if (section.offset % sizeof(uint64_t) != 0 || section.offset > size_ || section.size > size_ - section.offset) {
+            throw std::runtime_error("Search index is corrupted");
+        }
+    }
+    const Section* sections = header_->sections;
+    terms_ = ReadSection<TermInfo>(data, sections[kTermsSection]);
+    term_slots_ = ReadSection<uint32_t>(data, sections[kTermSlotsSection]);
+    names_ = std::string_view(data + sections[kNamesSection].offset, sections[kNamesSection].size);
+    blocks_ = ReadSection<PostingsBlock>(data, sections[kBlocksSection]);
+    postings_ = reinterpret_cast<const uint8_t*>(data + sections[kPostingsSection].offset);
+    lines_ = LineTable(ReadSection<uint64_t>(data, sections[kLineBlocksSection]),
+                       ReadSection<uint32_t>(data, sections[kLineBeginsSection]),
+                       ReadSection<uint32_t>(data, sections[kLineLengthsSection]),
+                       ReadSection<LongLine>(data, sections[kLongLinesSection]));
+    line_norms_ = ReadSection<float>(data, sections[kLineNormsSection]);
+    if (line_norms_.size() != lines_.Size() || sections[kPostingsSection].size < kStreamVByteTail ||
+        !std::has_single_bit(term_slots_.size()) || term_slots_.size() <= terms_.size()) {
+        throw std::runtime_error("Search index is corrupted");
+    }
+}
+
+// Indexes text[begin, end), which must start at the beginning of a line, and appends it to the index
+void IndexRange(std::string_view text, size_t begin, size_t end, size_t threads_count, IndexShard& index) {
+    const bool with_positions = index.with_positions;
+    size_t shards_count = threads_count == 1 ? 1 : threads_count * kShardsPerThread;
+    shards_count = std::min(shards_count, (end - begin) / kMinShardSize + 1);
+    std::vector<size_t> bounds = SplitIntoShards(text, begin, end, shards_count);
+    std::vector<IndexShard> shards(bounds.size() - 1);
+    RunInParallel(shards.size(), threads_count,
+                  [&](size_t i) { shards[i] = BuildShard(text, bounds[i], bounds[i + 1], with_positions); });
+    for (auto& shard : shards) {
+        MergeShard(shard, index);
+        shard = {};
+    }
+}
+
+// Maps a whole file into memory. The mapping of an empty file is null.
+std::shared_ptr<const void> MapFile(const std::string& path, const std::string& description, size_t& size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + description + " " + path);
+    }
+    struct stat file_stat = {};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read " + description + " " + path);
+    }
+    size = file_stat.st_size;
+    if (size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + description + " " + path);
+    }
+    return std::shared_ptr<const void>(data, [size](const void* data) { munmap(const_cast<void*>(data), size); });
+}
+
+std::shared_ptr<const SearchIndex> SearchIndex::Build(std::string_view text, size_t threads_count,
+                                                      bool with_positions) {
+    IndexShard index;
+    index.with_positions = with_positions;
+    IndexRange(text, 0, text.size(), threads_count, index);
+    return FromShard(index, text);
+}
+
+// The file is indexed chunk by chunk, each chunk extended to the end of the line crossing its end. Every chunk is
+// encoded into an index of its own as soon as it is indexed, and neighbouring chunk indexes are merged when the older
+// one is less than twice as large as the newer, so at most one chunk is held uncompressed and few indexes are left to
+// merge at the end. Pages of indexed chunks are dropped from the mapping, so at most one chunk of the text is resident
+// at a time while building; they are read back on demand when lines are returned by searches.
+std::shared_ptr<const SearchIndex> SearchIndex::BuildFromFile(const std::string& path, size_t threads_count,
+                                                              size_t chunk_size, bool with_positions) {
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = MapFile(path, "text", size);
+    std::string_view text(static_cast<const char*>(mapping.get()), size);
+    char* pages = static_cast<char*>(const_cast<void*>(mapping.get()));
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    if (!mapping) {
+        IndexShard index;
+        index.with_positions = with_positions;
+        return FromShard(index, text);
+    }
+    madvise(pages, size, MADV_SEQUENTIAL);
+    std::vector<std::shared_ptr<const SearchIndex>> chunks;
+    size_t released = 0;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = begin + chunk_size < text.size() ? text.find('\n', begin + chunk_size) : std::string_view::npos;
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        std::string_view chunk = text.substr(begin, end - begin);
+        IndexShard index;
+        index.with_positions = with_positions;
+        IndexRange(chunk, 0, chunk.size(), threads_count, index);
+        size_t release_end = end / page_size * page_size;
+        if (release_end > released) {
+            madvise(pages + released, release_end - released, MADV_DONTNEED);
+            released = release_end;
+        }
+        chunks.push_back(FromShard(index, chunk, mapping));
+        while (chunks.size() > 1 && chunks[chunks.size() - 2]->Text().size() < 2 * chunks.back()->Text().size()) {
+            std::shared_ptr<const SearchIndex> merged = Merge(std::span(chunks).last(2));
+            chunks.pop_back();
+            chunks.back() = std::move(merged);
+        }
+        begin = end;
+    }
+    return chunks.size() == 1 ? chunks[0] : Merge(chunks);
+}
+
+// Terms get ids in the order the indexes are given, which is their order of first appearance in the whole text, and
+// the postings of every term are concatenated with line numbers shifted by the lines of the preceding indexes
+std::shared_ptr<const SearchIndex> SearchIndex::Merge(std::span<const std::shared_ptr<const SearchIndex>> indexes) {
+    const std::string_view first = indexes.front()->Text();
+    const std::string_view last = indexes.back()->Text();
+    const std::string_view text(first.data(), last.data() + last.size() - first.data());
+    IndexShard merged;
+    merged.with_positions = std::all_of(indexes.begin(), indexes.end(),
+                                        [](const auto& index) { return index->HasPositions(); });
+    std::vector<uint32_t> first_lines;
+    std::shared_ptr<const void> text_storage;
+    for (const auto& index : indexes) {
+        first_lines.push_back(static_cast<uint32_t>(merged.lines.Size()));
+        if (merged.lines.Size() + index->LinesCount() > UINT32_MAX) {
+            throw std::length_error("Too many lines to index");
+        }
+        const size_t text_offset = index->text_.data() - text.data();
+        for (size_t line = 0; line < index->LinesCount(); ++line) {
+            auto [begin, end] = index->lines_.Get(line);
+            merged.lines.Add(text_offset + begin, text_offset + end);
+        }
+        merged.line_norms.insert(merged.line_norms.end(), index->line_norms_.begin(), index->line_norms_.end());
+        merged.lines_with_words += index->LinesWithWords();
+        merged.words_count += index->WordsCount();
+        for (uint32_t id = 0; id < index->terms_.size(); ++id) {
+            merged.terms.Intern(index->GetTermName(id));
+        }
+        if (!text_storage) {
+            text_storage = index->text_storage_;
+        }
+    }
+    merged.postings.resize(merged.terms.Size());
+    if (merged.with_positions) {
+        merged.positions.resize(merged.terms.Size());
+    }
+    PostingList decoded;
+    auto load_term = [&](uint32_t id) {
+        std::string_view name = merged.terms.GetTerm(id);
+        for (size_t i = 0; i < indexes.size(); ++i) {
+            uint32_t index_id = indexes[i]->FindTerm(name);
+            if (index_id == kNoTerm) {
+                continue;
+            }
+            indexes[i]->DecodePostings(indexes[i]->GetTerm(index_id), decoded, merged.with_positions);
+            for (size_t j = 0; j < decoded.lines.size(); ++j) {
+                merged.postings[id].push_back({decoded.lines[j] + first_lines[i], decoded.counts[j]});
+            }
+            if (merged.with_positions) {
+                merged.positions[id].insert(merged.positions[id].end(), decoded.positions.begin(),
+                                            decoded.positions.end());
+            }
+        }
+    };
+    return FromShard(merged, text, std::move(text_storage), load_term);
+}
+
+std::shared_ptr<const SearchIndex> SearchIndex::FromShard(IndexShard& index, std::string_view text,
+                                                          std::shared_ptr<const void> text_storage,
+                                                          const std::function<void(uint32_t)>& load_term) {
+    auto buffer = std::make_shared<std::vector<uint64_t>>(SerializeIndex(index, text, load_term));
+    size_t size = buffer->size() * sizeof(uint64_t);
+    std::shared_ptr<const void> storage(buffer, buffer->data());
+    std::shared_ptr<SearchIndex> result(new SearchIndex(text, std::move(storage), size));
+    result->text_storage_ = std::move(text_storage);
+    return result;
+}
+
+std::shared_ptr<const SearchIndex> SearchIndex::Load(const std::string& path, std::string_view text) {
+    size_t size = 0;
+    std::shared_ptr<const void> storage = MapFile(path, "search index", size);
+    if (size < sizeof(IndexHeader)) {
+        throw std::runtime_error("Not a search index: " + path);
+    }
+    return std::shared_ptr<const SearchIndex>(new SearchIndex(text, std::move(storage), size));
+}
+
+// Writes a temporary file and renames it, so processes that have mapped the previous file are not affected
+void SearchIndex::Save(const std::string& path) const {
+    const std::string temporary_path = path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file.write(static_cast<const char*>(storage_.get()), static_cast<std::streamsize>(size_));
+    file.close();
+    if (file.fail() || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        throw std::runtime_error("Cannot write search index " + path);
+    }
+}
+
+std::string_view SearchIndex::Text() const {
+    return text_;
+}
+
+size_t SearchIndex::StorageSize() const {
+    return size_;
+}
+
+std::string_view SearchIndex::GetLine(size_t line) const {
+    auto [begin, end] = lines_.Get(line);
+    return text_.substr(begin, end - begin);
+}
+
+size_t SearchIndex::LinesCount() const {
+    return lines_.Size();
+}
+
+uint32_t SearchIndex::FindTerm(std::string_view word) const {
+    return FindTermSlot(term_slots_, word, [this](uint32_t id) { return GetTermName(id); });
+}
+
+const TermInfo& SearchIndex::GetTerm(uint32_t id) const {
+    return terms_[id];
+}
+
+std::string_view SearchIndex::GetTermName(uint32_t id) const {
+    return names_.substr(terms_[id].name_offset, terms_[id].name_length);
+}
+
+float SearchIndex::GetLineNorm(size_t line) const {
+    return line_norms_[line];
+}
+
+size_t SearchIndex::LinesWithWords() const {
+    return header_->lines_with_words;
+}
+
+uint64_t SearchIndex::WordsCount() const {
+    return header_->words_count;
+}
+
+void SearchIndex::DecodePostings(const TermInfo& term, PostingList& postings, bool with_positions) const {
+    postings.lines.resize(term.document_frequency);
+    postings.counts.resize(term.document_frequency);
+    postings.positions.clear();
+    size_t decoded = 0;
+    uint32_t previous_line = 0;
+    for (const PostingsBlock& block : GetBlocks(term)) {
+        uint32_t* counts = postings.counts.data() + decoded;
+        const uint8_t* data = DecodeBlock(block, previous_line, postings.lines.data() + decoded, counts);
+        if (with_positions) {
+            size_t positions_count = 0;
+            for (size_t i = 0; i < block.count; ++i) {
+                positions_count += counts[i];
+            }
+            size_t position = postings.positions.size();
+            postings.positions.resize(position + positions_count);
+            uint32_t* positions = postings.positions.data() + position;
+            DecodeStreamVByte(data, positions_count, 0, false, positions);
+            for (size_t i = 0; i < block.count; positions += counts[i++]) {
+                for (uint32_t j = 1; j < counts[i]; ++j) {
+                    positions[j] += positions[j - 1];
+                }
+            }
+        }
+        decoded += block.count;
+        previous_line = block.last_line;
+    }
+}
+
+bool SearchIndex::HasPositions() const {
+    return header_->positions != 0;
+}
+
+std::span<const PostingsBlock> SearchIndex::GetBlocks(const TermInfo& term) const {
+    return blocks_.subspan(term.blocks_offset, term.blocks_count);
+}
+
+size_t SearchIndex::BlocksSize(std::span<const PostingsBlock> blocks) const {
+    if (blocks.empty()) {
+        return 0;
+    }
+    size_t end = blocks.data() + blocks.size() - blocks_.data();
+    uint64_t end_offset = end < blocks_.size() ? blocks_[end].offset
+                                               : header_->sections[kPostingsSection].size - kStreamVByteTail;
+    return end_offset - blocks.front().offset;
+}
+
+const uint8_t* SearchIndex::DecodeBlock(const PostingsBlock& block, uint32_t previous_line, uint32_t* lines,
+                                        uint32_t* counts) const {
+    const uint8_t* data = postings_ + block.offset;
+    data += DecodeStreamVByte(data, block.count, previous_line, true, lines);
+    return data + DecodeStreamVByte(data, block.count, 0, false, counts);
+}
+
+PostingCursor::PostingCursor(const SearchIndex& index, const TermInfo& term)
+    : index_(&index), blocks_(index.GetBlocks(term)) {
+    DecodeCurrentBlock();
+}
+
+uint32_t PostingCursor::Line() const {
+    return block_ == blocks_.size() ? kEnd : lines_[position_];
+}
+
+uint32_t PostingCursor::Count() const {
+    return counts_[position_];
+}
+
+void PostingCursor::Next() {
+    if (++position_ == blocks_[block_].count) {
+        ++block_;
+        DecodeCurrentBlock();
+    }
+}
+
+void PostingCursor::SkipTo(uint32_t line) {
+    ShallowSkipTo(line);
+    DecodeCurrentBlock();
+    if (block_ < blocks_.size()) {
+        position_ = std::lower_bound(lines_ + position_, lines_ + blocks_[block_].count, line) - lines_;
+    }
+}
+
+void PostingCursor::ShallowSkipTo(uint32_t line) {
+    while (block_ < blocks_.size() && blocks_[block_].last_line < line) {
+        ++block_;
+    }
+}
+
+double PostingCursor::BlockMaxTf() const {
+    return block_ == blocks_.size() ? 0 : blocks_[block_].max_tf;
+}
+
+const PostingsBlock* PostingCursor::DecodedBlock() const {
+    return decoded_block_ == SIZE_MAX ? nullptr : &blocks_[decoded_block_];
+}
+
+void PostingCursor::DecodeCurrentBlock() {
+    if (block_ == decoded_block_ || block_ == blocks_.size()) {
+        return;
+    }
+    index_->DecodeBlock(blocks_[block_], block_ == 0 ? 0 : blocks_[block_ - 1].last_line, lines_, counts_);
+    decoded_block_ = block_;
+    position_ = 0;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "dictionary.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct TermInfo {
+    uint64_t name_offset;
+    uint64_t blocks_offset;       // first block of the postings of the term
+    uint64_t document_frequency;  // number of postings of the term
+    double max_tf;                // largest term frequency over the lines of the term
+    uint32_t name_length;
+    uint32_t blocks_count;
+};
+
+// Postings are stored in blocks of up to kPostingsBlockSize lines. A block holds the Stream VByte encoded
+// differences between consecutive line numbers followed by the encoded occurrence counts and, in an index with
+// positions, by the encoded positions of the occurrences.
+struct PostingsBlock {
+    uint64_t offset;     // in the postings section
+    uint32_t last_line;  // line numbers of the block are differences from the last line of the previous block
+    uint32_t count;
+    double max_tf;  // largest term frequency over the lines of the block
+};
+
+// Decoded postings of a term
+struct PostingList {
+    std::vector<uint32_t> lines;   // numbers of the non-empty lines containing the term, in increasing order
+    std::vector<uint32_t> counts;  // occurrences of the term in each of the lines
+    // If requested, word numbers of the occurrences within their lines: counts[0] of them for the first line, and so on
+    std::vector<uint32_t> positions;
+};
+
+struct LongLine {
+    uint64_t line;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Boundaries of the non-empty lines of the text. Offsets are stored relative to the start of a block of lines,
+// which takes 8 bytes per line instead of 16 and still allows constant time lookup.
+class LineTable {
+public:
+    static constexpr size_t kBlockSize = 64;
+    static constexpr uint32_t kLongLine = UINT32_MAX;
+
+    LineTable() = default;
+    LineTable(std::span<const uint64_t> block_begin, std::span<const uint32_t> begin,
+              std::span<const uint32_t> length, std::span<const LongLine> long_lines);
+
+    std::pair<size_t, size_t> Get(size_t line) const;
+    size_t Size() const;
+
+    std::span<const uint64_t> BlockBegins() const;
+    std::span<const uint32_t> Begins() const;
+    std::span<const uint32_t> Lengths() const;
+    std::span<const LongLine> LongLines() const;
+
+private:
+    std::span<const uint64_t> block_begin_;
+    std::span<const uint32_t> begin_;
+    std::span<const uint32_t> length_;
+    std::span<const LongLine> long_lines_;  // lines not fitting into 32-bit offsets, ordered by line
+};
+
+const size_t kPostingsBlockSize = 128;
+const size_t kFileChunkSize = 1 << 26;
+
+class LineTableBuilder {
+public:
+    void Add(size_t begin, size_t end);
+    size_t Size() const;
+    LineTable View() const;
+
+private:
+    std::vector<uint64_t> block_begin_;
+    std::vector<uint32_t> begin_;
+    std::vector<uint32_t> length_;
+    std::vector<LongLine> long_lines_;
+};
+
+struct IndexHeader;
+struct IndexShard;
+
+// Immutable result of indexing a text. It is never modified after being built, so any number of threads may read
+// it at once.
+//
+// The index is stored in a single buffer whose layout is also the on-disk format: a header followed by sections
+// with the term dictionary and its hash table, compressed postings and line table. Save writes the buffer as is,
+// and Load maps the file into memory without parsing it, so several processes loading one file share its pages.
+// Lines are numbered with 32-bit integers, terms with dense ids in order of first appearance in the text.
+class SearchIndex {
+public:
+    // With positions, the index also stores the word numbers of every occurrence of a term within its line
+    static std::shared_ptr<const SearchIndex> Build(std::string_view text, size_t threads_count,
+                                                    bool with_positions = false);
+    // Indexes a file mapped into memory, reading chunk_size bytes of it at a time. The index keeps the mapping, and
+    // its lines point into it.
+    static std::shared_ptr<const SearchIndex> BuildFromFile(const std::string& path, size_t threads_count,
+                                                            size_t chunk_size = kFileChunkSize,
+                                                            bool with_positions = false);
+    // Merges indexes of consecutive parts of a text into the index of the whole text, identical to the one Build
+    // gives, without reading the text: postings are decoded and encoded again one term at a time. The parts must
+    // follow each other in memory and each of them but the last must end with a line break.
+    static std::shared_ptr<const SearchIndex> Merge(std::span<const std::shared_ptr<const SearchIndex>> indexes);
+    // The text must be the one the file was built from; its size and fingerprint are checked
+    static std::shared_ptr<const SearchIndex> Load(const std::string& path, std::string_view text);
+    void Save(const std::string& path) const;
+
+    std::string_view Text() const;
+    // Bytes taken by the index itself, not counting the text
+    size_t StorageSize() const;
+    std::string_view GetLine(size_t line) const;
+    size_t LinesCount() const;
+    // Length of a line in words, stored as a float so that scorers divide by it without conversions
+    float GetLineNorm(size_t line) const;
+    // Number of lines with at least one word, the collection size used for inverse document frequencies
+    size_t LinesWithWords() const;
+    // Number of words in the text, from which scorers get the average line length
+    uint64_t WordsCount() const;
+
+    // Id of the term matching the word in any case, or kNoTerm
+    uint32_t FindTerm(std::string_view word) const;
+    const TermInfo& GetTerm(uint32_t id) const;
+    std::string_view GetTermName(uint32_t id) const;
+    bool HasPositions() const;
+    void DecodePostings(const TermInfo& term, PostingList& postings, bool with_positions = false) const;
+    std::span<const PostingsBlock> GetBlocks(const TermInfo& term) const;
+    // Bytes taken by consecutive blocks of the index when encoded
+    size_t BlocksSize(std::span<const PostingsBlock> blocks) const;
+    // Decodes a block into kPostingsBlockSize-sized arrays. previous_line is the last line of the previous block.
+    // Returns the encoded positions of the block.
+    const uint8_t* DecodeBlock(const PostingsBlock& block, uint32_t previous_line, uint32_t* lines,
+                               uint32_t* counts) const;
+
+private:
+    SearchIndex(std::string_view text, std::shared_ptr<const void> storage, size_t size);
+    // load_term, if given, fills the postings of a term of the shard when they are encoded, as in Merge
+    static std::shared_ptr<const SearchIndex> FromShard(IndexShard& index, std::string_view text,
+                                                        std::shared_ptr<const void> text_storage = nullptr,
+                                                        const std::function<void(uint32_t)>& load_term = nullptr);
+
+    std::string_view text_;
+    std::shared_ptr<const void> text_storage_;  // memory mapping of the text if it was indexed from a file
+    std::shared_ptr<const void> storage_;       // heap buffer or memory mapping holding the data below
+    size_t size_;
+    const IndexHeader* header_;
+    std::span<const TermInfo> terms_;  // by term id
+    std::span<const uint32_t> term_slots_;
+    std::string_view names_;
+    std::span<const PostingsBlock> blocks_;
+    const uint8_t* postings_;
+    LineTable lines_;
+    std::span<const float> line_norms_;
+};
+
+// Reads the postings of a term in line order, decoding only the blocks it stops in
+class PostingCursor {
+public:
+    static constexpr uint32_t kEnd = UINT32_MAX;
+
+    PostingCursor(const SearchIndex& index, const TermInfo& term);
+
+    // Line of the current posting, or kEnd past the last one
+    uint32_t Line() const;
+    uint32_t Count() const;
+    void Next();
+    // Moves to the first posting with a line not less than the given one
+    void SkipTo(uint32_t line);
+    // Moves to the block that may hold the line without decoding it. SkipTo must be called before reading postings.
+    void ShallowSkipTo(uint32_t line);
+    // Largest term frequency in the current block, zero past the last one
+    double BlockMaxTf() const;
+    // Last block whose postings were decoded, or null
+    const PostingsBlock* DecodedBlock() const;
+
+private:
+    void DecodeCurrentBlock();
+
+    const SearchIndex* index_;
+    std::span<const PostingsBlock> blocks_;
+    size_t block_ = 0;
+    size_t decoded_block_ = SIZE_MAX;
+    size_t position_ = 0;
+    uint32_t lines_[kPostingsBlockSize];
+    uint32_t counts_[kPostingsBlockSize];
+};
@@ -0,0 +1,157 @@
+#include "search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Measures indexing and search latency on synthetic corpora of growing size. Words are drawn from a Zipf
+// distribution, as in natural texts, so that a few terms have huge posting lists and most have short ones. Corpora
+// are written to a file and indexed with BuildIndexFromFile, so they may be larger than RAM.
+//
+// Every measurement is printed as one line of key=value pairs, which can be diffed between versions or loaded into
+// a table.
+//
+// Usage: latency_search2 [size...], sizes in bytes with an optional K, M or G suffix (1M 16M 128M by default)
+
+const size_t kVocabularySize = 1 << 18;
+const double kZipfExponent = 1;
+const size_t kMaxLineWords = 24;
+const size_t kQueriesPerCase = 1000;
+const size_t kMinQueriesPerCase = 50;
+const double kCaseSeconds = 5;
+
+struct Vocabulary {
+    std::vector<std::string> words;  // by rank, most frequent first
+    std::discrete_distribution<size_t> ranks;
+};
+
+// Frequent words are short, as in natural languages: ranks are written in bijective base 26
+Vocabulary MakeVocabulary() {
+    Vocabulary vocabulary;
+    std::vector<double> weights(kVocabularySize);
+    for (size_t rank = 0; rank < kVocabularySize; ++rank) {
+        std::string word;
+        for (size_t n = rank + 1; n > 0; n = (n - 1) / 26) {
+            word += static_cast<char>('a' + (n - 1) % 26);
+        }
+        vocabulary.words.push_back(std::move(word));
+        weights[rank] = 1 / std::pow(static_cast<double>(rank + 1), kZipfExponent);
+    }
+    vocabulary.ranks = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    return vocabulary;
+}
+
+// Writes whole lines of 1 to kMaxLineWords words until the file takes at least size bytes
+void WriteCorpus(const std::string& path, size_t size, Vocabulary& vocabulary, std::mt19937& rng) {
+    std::ofstream out(path, std::ios::binary);
+    std::string buffer;
+    for (size_t written = 0; written < size;) {
+        for (size_t words = rng() % kMaxLineWords + 1; words > 0; --words) {
+            buffer += vocabulary.words[vocabulary.ranks(rng)];
+            buffer += words == 1 ? '\n' : ' ';
+        }
+        if (buffer.size() >= (1 << 20) || written + buffer.size() >= size) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+    if (!out) {
+        throw std::runtime_error("Cannot write the corpus to " + path);
+    }
+}
+
+size_t ParseSize(const std::string& argument) {
+    size_t end = 0;
+    size_t size = std::stoull(argument, &end);
+    std::string suffix = argument.substr(end);
+    if (suffix == "K") {
+        return size << 10;
+    } else if (suffix == "M") {
+        return size << 20;
+    } else if (suffix == "G") {
+        return size << 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("Unknown size suffix in " + argument);
+    }
+    return size;
+}
+
+long PeakMemoryKb() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Latencies of queries of terms_count words drawn from the corpus distribution, so frequent terms are queried more
+void BenchmarkQueries(const SearchEngine& search_engine, size_t corpus_size, Vocabulary& vocabulary,
+                      std::mt19937& rng) {
+    for (size_t terms_count : {1, 2, 4, 8}) {
+        for (size_t results_count : {1, 10, 100}) {
+            std::vector<std::string> queries(kQueriesPerCase);
+            for (auto& query : queries) {
+                for (size_t i = 0; i < terms_count; ++i) {
+                    query += vocabulary.words[vocabulary.ranks(rng)] + " ";
+                }
+            }
+            std::vector<double> latencies;
+            auto case_start = std::chrono::steady_clock::now();
+            for (const auto& query : queries) {
+                auto start = std::chrono::steady_clock::now();
+                search_engine.Search(query, results_count);
+                auto end = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                if (latencies.size() >= kMinQueriesPerCase &&
+                    std::chrono::duration<double>(end - case_start).count() > kCaseSeconds) {
+                    break;
+                }
+            }
+            double total = 0;
+            for (double latency : latencies) {
+                total += latency;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << "query bytes=" << corpus_size << " terms=" << terms_count << " k=" << results_count
+                      << " queries=" << latencies.size() << " p50_us=" << latencies[latencies.size() / 2]
+                      << " p99_us=" << latencies[latencies.size() * 99 / 100]
+                      << " mean_us=" << total / static_cast<double>(latencies.size()) << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(ParseSize(argv[i]));
+    }
+    if (sizes.empty()) {
+        sizes = {1 << 20, 16 << 20, 128 << 20};
+    }
+    std::mt19937 rng(0);
+    Vocabulary vocabulary = MakeVocabulary();
+    const std::string path = "latency_search2_corpus.txt";
+    for (size_t size : sizes) {
+        WriteCorpus(path, size, vocabulary, rng);
+        {
+            SearchEngine search_engine;
+            auto start = std::chrono::steady_clock::now();
+            search_engine.BuildIndexFromFile(path);
+            auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            // The peak is over the whole run, so it is the peak of this build as long as sizes increase
+            std::cout << "build bytes=" << size << " ms=" << static_cast<size_t>(time.count())
+                      << " index_bytes=" << search_engine.IndexMemory() << " peak_rss_kb=" << PeakMemoryKb()
+                      << std::endl;
+            BenchmarkQueries(search_engine, size, vocabulary, rng);
+        }
+        std::remove(path.c_str());
+    }
+}
@@ -0,0 +1,114 @@
+#include "phrase.h"
+#include "tokenizer.h"
+
+#include <algorithm>
+
+std::vector<Phrase> ParsePhrases(std::string_view query) {
+    std::vector<Phrase> phrases;
+    for (size_t begin = query.find('"'); begin != std::string_view::npos; begin = query.find('"', begin)) {
+        size_t end = query.find('"', begin + 1);
+        if (end == std::string_view::npos) {
+            break;
+        }
+        Phrase phrase;
+        std::string_view inner = query.substr(begin + 1, end - begin - 1);
+        Tokenize(inner, [&](size_t word_begin, size_t word_end) {
+            phrase.words.push_back(inner.substr(word_begin, word_end - word_begin));
+        }, [](size_t) {});
+        begin = end + 1;
+        auto is_digit = [&query](size_t i) { return i < query.size() && query[i] >= '0' && query[i] <= '9'; };
+        if (begin < query.size() && query[begin] == '~' && is_digit(begin + 1)) {
+            size_t slop = 0;
+            for (++begin; is_digit(begin); ++begin) {
+                slop = std::min<size_t>(slop * 10 + (query[begin] - '0'), UINT32_MAX);
+            }
+            phrase.slop = slop;
+        }
+        if (!phrase.words.empty()) {
+            phrases.push_back(std::move(phrase));
+        }
+    }
+    return phrases;
+}
+
+size_t Gallop(std::span<const uint32_t> values, size_t begin, uint32_t target) {
+    size_t end = begin;
+    for (size_t step = 1; end < values.size() && values[end] < target; step *= 2) {
+        begin = end + 1;
+        end += step;
+    }
+    end = std::min(end, values.size());
+    return std::lower_bound(values.begin() + begin, values.begin() + end, target) - values.begin();
+}
+
+struct PhraseWord {
+    PostingList postings;
+    std::vector<size_t> offsets;  // positions of postings[i] start at offsets[i]
+    size_t posting = 0;           // current posting, advanced by galloping
+};
+
+// Whether the words with the given positions in a line occur in order, each within slop words of the previous one.
+// Goes word by word keeping the positions at which the chain of the previous words can end.
+bool MatchPositions(std::span<const std::span<const uint32_t>> positions, uint32_t slop,
+                    std::vector<uint32_t>& ends, std::vector<uint32_t>& next_ends) {
+    ends.assign(positions[0].begin(), positions[0].end());
+    for (size_t k = 1; k < positions.size() && !ends.empty(); ++k) {
+        next_ends.clear();
+        size_t end = 0;
+        for (uint32_t position : positions[k]) {
+            end = Gallop(ends, end, position > slop ? position - 1 - slop : 0);
+            if (end < ends.size() && ends[end] < position) {
+                next_ends.push_back(position);
+            }
+        }
+        std::swap(ends, next_ends);
+    }
+    return !ends.empty();
+}
+
+std::vector<uint32_t> MatchPhrase(const SearchIndex& index, const Phrase& phrase) {
+    std::vector<PhraseWord> words(phrase.words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        uint32_t id = index.FindTerm(phrase.words[i]);
+        if (id == kNoTerm) {
+            return {};
+        }
+        index.DecodePostings(index.GetTerm(id), words[i].postings, true);
+        words[i].offsets.resize(words[i].postings.counts.size() + 1);
+        for (size_t j = 0; j < words[i].postings.counts.size(); ++j) {
+            words[i].offsets[j + 1] = words[i].offsets[j] + words[i].postings.counts[j];
+        }
+    }
+    // Candidate lines are taken from the rarest word and looked up in the lists of the others
+    size_t rarest = 0;
+    for (size_t i = 1; i < words.size(); ++i) {
+        if (words[i].postings.lines.size() < words[rarest].postings.lines.size()) {
+            rarest = i;
+        }
+    }
+    const uint32_t slop = static_cast<uint32_t>(phrase.slop.value_or(0));
+    std::vector<uint32_t> matches;
+    std::vector<std::span<const uint32_t>> positions(words.size());
+    std::vector<uint32_t> ends;
+    std::vector<uint32_t> next_ends;
+    for (uint32_t line : words[rarest].postings.lines) {
+        bool all = true;
+        for (size_t i = 0; i < words.size() && all; ++i) {
+            PhraseWord& word = words[i];
+            word.posting = Gallop(word.postings.lines, word.posting, line);
+            all = word.posting < word.postings.lines.size() && word.postings.lines[word.posting] == line;
+            if (all) {
+                size_t offset = word.offsets[word.posting];
+                positions[i] = std::span<const uint32_t>(word.postings.positions)
+                                   .subspan(offset, word.offsets[word.posting + 1] - offset);
+            }
+        }
+        if (!all) {
+            continue;
+        }
+        if (MatchPositions(positions, slop, ends, next_ends)) {
+            matches.push_back(line);
+        }
+    }
+    return matches;
+}
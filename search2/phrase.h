@@ -0,0 +1,27 @@
+#pragma once
+
+#include "index.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Quoted part of a query. "words" requires the words to follow each other in this order in a line, and "words"~N
+// boosts the lines where they occur in this order with at most N other words between neighbours.
+struct Phrase {
+    std::vector<std::string_view> words;
+    std::optional<size_t> slop;  // set for proximity boosts
+};
+
+// Phrases of a query, ignoring an unpaired quote. The words of the query are tokenized as usual, quotes and slops
+// being separators.
+std::vector<Phrase> ParsePhrases(std::string_view query);
+
+// Index of the first value not less than the target among the values from begin on, found with steps doubling from
+// begin, so that advancing through a sorted list costs logarithm of the distance rather than of the list length
+size_t Gallop(std::span<const uint32_t> values, size_t begin, uint32_t target);
+
+// Lines of an index with positions that match the phrase, in increasing order
+std::vector<uint32_t> MatchPhrase(const SearchIndex& index, const Phrase& phrase);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Scorers are compile-time policies of the search engine computing how much a term adds to the score of a line.
+// A scorer is created per query from the statistics of the whole collection and provides:
+//   Weight(document_frequency), the weight of a term, computed once per query term;
+//   Score(weight, count, norm), the contribution of a term occurring count times in a line of norm words;
+//   Bound(weight, max_tf), an upper bound of Score over the lines where count / norm does not exceed max_tf, which
+//   allows skipping lines that cannot make it to the top.
+// The calls are resolved at compile time and inlined into the loops over postings.
+
+// Term frequency, normalized by the line length, times inverse document frequency
+class TfIdfScorer {
+public:
+    TfIdfScorer(size_t lines_with_words, uint64_t /*words_count*/)
+        : lines_with_words_(static_cast<double>(lines_with_words)) {
+    }
+
+    double Weight(uint64_t document_frequency) const {
+        return std::log(lines_with_words_ / static_cast<double>(document_frequency));
+    }
+
+    double Score(double weight, uint32_t count, float norm) const {
+        return weight * (static_cast<double>(count) / static_cast<double>(norm));
+    }
+
+    // Exact, as the stored max_tf is computed with the same division as Score
+    double Bound(double weight, double max_tf) const {
+        return weight * max_tf;
+    }
+
+private:
+    double lines_with_words_;
+};
+
+// Okapi BM25: the contribution of a term saturates as it repeats, and longer than average lines need more
+// occurrences to score as high
+class Bm25Scorer {
+public:
+    static constexpr double kK1 = 1.2;  // saturation of repeated occurrences
+    static constexpr double kB = 0.75;  // strength of the line length normalization
+
+    Bm25Scorer(size_t lines_with_words, uint64_t words_count)
+        : lines_with_words_(static_cast<double>(lines_with_words)),
+          length_factor_(words_count == 0 ? 0
+                                          : kK1 * kB * static_cast<double>(lines_with_words) /
+                                                static_cast<double>(words_count)) {
+    }
+
+    // Smoothed inverse document frequency, positive even for the terms of most lines
+    double Weight(uint64_t document_frequency) const {
+        double frequency = static_cast<double>(document_frequency);
+        return std::log(1 + (lines_with_words_ - frequency + 0.5) / (frequency + 0.5));
+    }
+
+    double Score(double weight, uint32_t count, float norm) const {
+        double occurrences = static_cast<double>(count);
+        return weight * (occurrences * (kK1 + 1)) /
+               (occurrences + kK1 * (1 - kB) + length_factor_ * static_cast<double>(norm));
+    }
+
+    // Dropping the constant term of the denominator and writing count as tf * norm leaves a bound that depends only
+    // on tf and grows with it
+    double Bound(double weight, double max_tf) const {
+        return weight * (kK1 + 1) * max_tf / (max_tf + length_factor_);
+    }
+
+private:
+    double lines_with_words_;
+    double length_factor_;  // k1 * b / average line length
+};
@@ -1,163 +1,710 @@
 #include "search.h"
+#include "tokenizer.h"
 
 #include <string>
 #include <iostream>
-#include <set>
+#include <span>
 #include <algorithm>
 #include <vector>
 #include <cmath>
 #include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+#include <queue>
 
-bool LowerEqual(const std::string_view& str1, const std::string_view& str2) {
-    if (str1.size() != str2.size()) {
-        return false;
+bool LessFolded(std::string_view lhs, std::string_view rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                                        [](char lhs, char rhs) { return (lhs | 0x20) < (rhs | 0x20); });
+}
+
+// Distinct words of the query ordered by their lowercase forms, the order in which term scores are summed whichever
+// case the words are typed in
+std::vector<std::string_view> NormalizeQuery(const std::string_view& input) {
+    std::vector<std::string_view> words;
+    Tokenize(input, [&](size_t begin, size_t end) { words.push_back(input.substr(begin, end - begin)); },
+             [](size_t) {});
+    std::sort(words.begin(), words.end(), LessFolded);
+    auto equal = [](std::string_view lhs, std::string_view rhs) {
+        return !LessFolded(lhs, rhs) && !LessFolded(rhs, lhs);
+    };
+    words.erase(std::unique(words.begin(), words.end(), equal), words.end());
+    return words;
+}
+
+// A query term with its statistics summed over all segments
+struct QueryTerm {
+    double weight;
+    std::vector<const TermInfo*> infos;  // by segment, null in the segments without the term
+};
+
+// Terms of the query found in the index, in summation order
+template <class Scorer>
+std::vector<QueryTerm> PrepareQuery(const SegmentedIndex& index, const std::string_view& query, const Scorer& scorer) {
+    std::vector<QueryTerm> terms;
+    for (std::string_view word : NormalizeQuery(query)) {
+        QueryTerm term = {0, std::vector<const TermInfo*>(index.Segments().size())};
+        size_t document_frequency = 0;
+        for (size_t i = 0; i < term.infos.size(); ++i) {
+            const SearchIndex& segment = *index.Segments()[i].index;
+            uint32_t id = segment.FindTerm(word);
+            if (id != kNoTerm) {
+                term.infos[i] = &segment.GetTerm(id);
+                document_frequency += term.infos[i]->document_frequency;
+            }
+        }
+        if (document_frequency != 0) {
+            term.weight = scorer.Weight(document_frequency);
+            terms.push_back(std::move(term));
+        }
+    }
+    return terms;
+}
+
+// Keeps at most results_count lines with a nonzero score, ordered by decreasing score and then by line.
+// Scores are negated, as in the sorted order of (score, line) pairs.
+class TopResults {
+public:
+    explicit TopResults(size_t results_count) : results_count_(results_count) {
+    }
+
+    void Add(double score, size_t line) {
+        if (score >= 0 || results_count_ == 0) {
+            return;
+        }
+        if (top_.size() < results_count_) {
+            top_.emplace(score, line);
+        } else if (std::make_pair(score, line) < top_.top()) {
+            top_.pop();
+            top_.emplace(score, line);
+        }
+    }
+
+    // Score a line has to exceed to be kept, if lines are added in increasing order
+    double Threshold() const {
+        return top_.size() < results_count_ ? 0 : -top_.top().first;
     }
-    for (size_t i = 0; i < str1.size(); ++i) {
-        if (std::tolower(str1[i]) != str2[i]) {
-            return false;
+
+    std::vector<std::pair<double, size_t>> Extract() {
+        std::vector<std::pair<double, size_t>> results(top_.size());
+        for (size_t i = results.size(); i > 0; --i) {
+            results[i - 1] = top_.top();
+            top_.pop();
+        }
+        return results;
+    }
+
+private:
+    size_t results_count_;
+    std::priority_queue<std::pair<double, size_t>> top_;  // the worst of the kept results is on top
+};
+
+// Negated scores of all the lines containing query words
+template <class Scorer, class Trace>
+std::unordered_map<size_t, double> ScoreLines(const SegmentedIndex& index, const std::string_view& query,
+                                              Trace& trace) {
+    trace.Enter(kParsePhase);
+    std::unordered_map<size_t, double> scores;
+    PostingList postings;
+    const Scorer scorer(index.LinesWithWords(), index.WordsCount());
+    std::vector<QueryTerm> terms = PrepareQuery(index, query, scorer);
+    trace.Enter(kScorePhase);
+    for (const QueryTerm& term : terms) {
+        for (size_t i = 0; i < term.infos.size(); ++i) {
+            if (!term.infos[i]) {
+                continue;
+            }
+            const SegmentedIndex::Segment& segment = index.Segments()[i];
+            segment.index->DecodePostings(*term.infos[i], postings);
+            if constexpr (Trace::kEnabled) {
+                trace.CountBlocks(*segment.index, segment.index->GetBlocks(*term.infos[i]));
+            }
+            for (size_t j = 0; j < postings.lines.size(); ++j) {
+                uint32_t line = postings.lines[j];
+                scores[segment.first_line + line] -=
+                    scorer.Score(term.weight, postings.counts[j], segment.index->GetLineNorm(line));
+            }
         }
     }
-    return true;
+    if constexpr (Trace::kEnabled) {
+        trace.lines_scored += scores.size();
+    }
+    return scores;
+}
+
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTop(const SegmentedIndex& index, const std::string_view& query,
+                                                    size_t results_count) {
+    if (results_count == 0) {
+        return {};
+    }
+    NoTrace trace;
+    TopResults top(results_count);
+    for (const auto& [line, score] : ScoreLines<Scorer>(index, query, trace)) {
+        top.Add(score, line);
+    }
+    return top.Extract();
 }
 
-std::pair<size_t, size_t> FindStringBoundaries(const std::string_view& text, size_t string_number) {
-    bool not_empty = false;
-    bool found_first = false;
-    size_t strings = 0;
-    std::pair<size_t, size_t> ans;
-    for (size_t i = 0; i <= text.size(); ++i) {
-        if (strings == string_number) {
-            if (!found_first && text[i] != '\n') {
-                found_first = true;
-                ans.first = i;
+const double kProximityBoost = 2;
+
+template <class Scorer, class Trace>
+std::vector<std::pair<double, size_t>> CalculateTopPhrases(const SegmentedIndex& index, const std::string_view& query,
+                                                           std::span<const Phrase> phrases, size_t results_count,
+                                                           Trace& trace) {
+    if (results_count == 0) {
+        return {};
+    }
+    std::unordered_map<size_t, double> scores = ScoreLines<Scorer>(index, query, trace);
+    for (const Phrase& phrase : phrases) {
+        std::vector<size_t> matches;
+        for (const SegmentedIndex::Segment& segment : index.Segments()) {
+            for (uint32_t line : MatchPhrase(*segment.index, phrase)) {
+                matches.push_back(segment.first_line + line);
             }
-            ans.second = i;
         }
-        if (text[i] != '\n') {
-            not_empty = true;
+        if (phrase.slop) {
+            for (size_t line : matches) {
+                if (auto it = scores.find(line); it != scores.end()) {
+                    it->second *= kProximityBoost;
+                }
+            }
         } else {
-            strings += not_empty;
-            not_empty = false;
+            std::erase_if(scores, [&matches](const auto& score) {
+                return !std::binary_search(matches.begin(), matches.end(), score.first);
+            });
         }
     }
-    return ans;
+    trace.Enter(kSelectPhase);
+    TopResults top(results_count);
+    for (const auto& [line, score] : scores) {
+        top.Add(score, line);
+    }
+    return top.Extract();
 }
 
-std::set<std::string> NormalizeQuery(const std::string_view& input) {
-    std::set<std::string> words;
-    std::string word;
-    for (size_t i = 0; i < input.size(); ++i) {
-        if (!std::isalpha(input[i])) {
-            if (!word.empty()) {
-                words.insert(word);
-            }
-            word.clear();
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTopPhrases(const SegmentedIndex& index, const std::string_view& query,
+                                                           std::span<const Phrase> phrases, size_t results_count) {
+    NoTrace trace;
+    return CalculateTopPhrases<Scorer>(index, query, phrases, results_count, trace);
+}
+
+// Upper bounds are compared with this margin, far larger than the rounding errors of summing at most a few thousand
+// of them, so that a line is skipped only if its score computed as in CalculateTop cannot exceed the threshold
+const double kBoundSlack = 1 + 1e-9;
+
+// MaxScore over one segment: the lines are scored in increasing order, which makes a line enter the top only if its
+// score exceeds the threshold. Terms are ordered by their upper bounds, and the ones whose bounds together do not
+// exceed it are only looked up in the lines that contain the others, skipping whole blocks of postings. A line is
+// abandoned as soon as the terms found so far plus the block bounds of the remaining ones cannot exceed the threshold.
+template <class Scorer, class Trace>
+void ScoreSegmentPruned(const SegmentedIndex& index, size_t segment_index, std::span<const QueryTerm> query_terms,
+                        const Scorer& scorer, TopResults& top, Trace& trace) {
+    struct SegmentTerm {
+        double weight;
+        double max_score;
+        PostingCursor cursor;
+        size_t rank;  // position of the term in the summation order
+    };
+    const SegmentedIndex::Segment& segment = index.Segments()[segment_index];
+    std::vector<SegmentTerm> terms;
+    for (size_t rank = 0; rank < query_terms.size(); ++rank) {
+        if (const TermInfo* info = query_terms[rank].infos[segment_index]) {
+            double weight = query_terms[rank].weight;
+            terms.push_back({weight, scorer.Bound(weight, info->max_tf), PostingCursor(*segment.index, *info), rank});
+        }
+    }
+    // A cursor decodes at most one block when created or moved
+    auto count_block = [&](const PostingCursor& cursor, const PostingsBlock* previous) {
+        if (cursor.DecodedBlock() != previous) {
+            trace.CountBlocks(*segment.index, std::span(cursor.DecodedBlock(), 1));
+        }
+    };
+    auto advance = [&](PostingCursor& cursor, auto move, auto... arguments) {
+        if constexpr (Trace::kEnabled) {
+            const PostingsBlock* previous = cursor.DecodedBlock();
+            (cursor.*move)(arguments...);
+            count_block(cursor, previous);
         } else {
-            word += static_cast<char>(std::tolower(input[i]));
+            (cursor.*move)(arguments...);
+        }
+    };
+    if constexpr (Trace::kEnabled) {
+        for (const SegmentTerm& term : terms) {
+            count_block(term.cursor, nullptr);
         }
     }
-    if (!word.empty()) {
-        words.insert(word);
+    std::stable_sort(terms.begin(), terms.end(),
+                     [](const SegmentTerm& lhs, const SegmentTerm& rhs) { return lhs.max_score < rhs.max_score; });
+    std::vector<double> bounds(terms.size() + 1);  // bounds[i] is the sum of the upper bounds of terms [0, i)
+    for (size_t i = 0; i < terms.size(); ++i) {
+        bounds[i + 1] = bounds[i] + terms[i].max_score;
     }
-    return words;
-}
 
-std::vector<std::vector<std::string_view>> NormalizeText(const std::string_view& text,
-                                                         bool include_punctuation = true) {
-    size_t index = 0;
-    for (size_t i = 0; i < text.size(); ++i) {
-        if (text[i] != '\n') {
-            index = i;
+    size_t essential = 0;  // lines containing only terms [0, essential) cannot exceed the threshold
+    auto update_essential = [&] {
+        while (essential < terms.size() && bounds[essential + 1] * kBoundSlack <= top.Threshold()) {
+            ++essential;
+        }
+    };
+    update_essential();
+    std::vector<double> contributions(query_terms.size());  // by rank
+    while (true) {
+        uint32_t line = PostingCursor::kEnd;
+        for (size_t i = essential; i < terms.size(); ++i) {
+            line = std::min(line, terms[i].cursor.Line());
+        }
+        if (line == PostingCursor::kEnd) {
             break;
         }
+        const float norm = segment.index->GetLineNorm(line);
+        double found = 0;
+        auto score_term = [&](SegmentTerm& term) {
+            double contribution = scorer.Score(term.weight, term.cursor.Count(), norm);
+            contributions[term.rank] = contribution;
+            found += contribution;
+        };
+        for (size_t i = essential; i < terms.size(); ++i) {
+            if (terms[i].cursor.Line() == line) {
+                score_term(terms[i]);
+                advance(terms[i].cursor, &PostingCursor::Next);
+            }
+        }
+        bool pruned = false;
+        for (size_t i = essential; i-- > 0;) {
+            terms[i].cursor.ShallowSkipTo(line);
+            double block_bound = scorer.Bound(terms[i].weight, terms[i].cursor.BlockMaxTf());
+            if ((found + bounds[i] + block_bound) * kBoundSlack <= top.Threshold()) {
+                pruned = true;
+                break;
+            }
+            advance(terms[i].cursor, &PostingCursor::SkipTo, line);
+            if (terms[i].cursor.Line() == line) {
+                score_term(terms[i]);
+            }
+        }
+        if (!pruned) {
+            double score = 0;
+            for (double contribution : contributions) {
+                score -= contribution;
+            }
+            top.Add(score, segment.first_line + line);
+            update_essential();
+        }
+        trace.CountLine(pruned);
+        std::fill(contributions.begin(), contributions.end(), 0);
     }
-    std::vector<std::vector<std::string_view>> res;
-    std::vector<std::string_view> vec;
-    for (size_t i = index; i < text.size(); ++i) {
-        if (text[i] == '\n') {
-            if (index != i) {
-                vec.emplace_back(std::string_view(text.data() + index, i - index));
+}
+
+// Segments are scored in text order, so lines keep being added to the top in increasing order
+template <class Scorer, class Trace>
+std::vector<std::pair<double, size_t>> CalculateTopPruned(const SegmentedIndex& index, const std::string_view& query,
+                                                          size_t results_count, Trace& trace) {
+    if (results_count == 0) {
+        return {};
+    }
+    trace.Enter(kParsePhase);
+    const Scorer scorer(index.LinesWithWords(), index.WordsCount());
+    std::vector<QueryTerm> terms = PrepareQuery(index, query, scorer);
+    trace.Enter(kScorePhase);
+    TopResults top(results_count);
+    for (size_t i = 0; i < index.Segments().size(); ++i) {
+        ScoreSegmentPruned(index, i, terms, scorer, top, trace);
+    }
+    trace.Enter(kSelectPhase);
+    return top.Extract();
+}
+
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTopPruned(const SegmentedIndex& index, const std::string_view& query,
+                                                          size_t results_count) {
+    NoTrace trace;
+    return CalculateTopPruned<Scorer>(index, query, results_count, trace);
+}
+
+// Phrases apply only to indexes with positions; otherwise quotes are separators like any other character
+std::vector<Phrase> GetPhrases(const SegmentedIndex& index, const std::string_view& query) {
+    return index.HasPositions() ? ParsePhrases(query) : std::vector<Phrase>();
+}
+
+template <class Scorer, class Trace>
+std::vector<std::pair<double, size_t>> CalculateResults(const SegmentedIndex& index, const std::string_view& query,
+                                                        std::span<const Phrase> phrases, size_t results_count,
+                                                        Trace& trace) {
+    if (!phrases.empty()) {
+        return CalculateTopPhrases<Scorer>(index, query, phrases, results_count, trace);
+    }
+    return CalculateTopPruned<Scorer>(index, query, results_count, trace);
+}
+
+// A batch keeps a dense array of scores only if the index has at most this many lines per posting of the batch
+const size_t kDenseLinesPerCandidate = 8;
+
+// Each distinct term of the batch is looked up and decoded once. The scores of all queries are accumulated in one
+// dense array allocated once per batch while the batch touches lines about as many times as the index has lines,
+// which is much cheaper than a hash map per query. For larger indexes the contributions of every query are sorted by
+// line instead, so that memory follows the postings of the batch rather than the size of the corpus.
+template <class Scorer>
+std::vector<std::vector<std::pair<double, size_t>>> CalculateTopBatch(const SegmentedIndex& index,
+                                                                     std::span<const std::string_view> queries,
+                                                                     size_t results_count) {
+    std::vector<std::vector<std::pair<double, size_t>>> results(queries.size());
+    if (results_count == 0) {
+        return results;
+    }
+    struct BatchTerm {
+        std::vector<size_t> lines;
+        std::vector<double> contributions;  // score of the term in each of the lines
+    };
+    TermDictionary dictionary;
+    std::vector<BatchTerm> terms;
+    std::vector<std::vector<uint32_t>> query_terms(queries.size());
+    std::vector<bool> with_phrases(queries.size());
+    PostingList postings;
+    const Scorer scorer(index.LinesWithWords(), index.WordsCount());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (std::vector<Phrase> phrases = GetPhrases(index, queries[i]); !phrases.empty()) {
+            results[i] = CalculateTopPhrases<Scorer>(index, queries[i], phrases, results_count);
+            with_phrases[i] = true;
+            continue;
+        }
+        for (std::string_view word : NormalizeQuery(queries[i])) {
+            uint32_t id = dictionary.Intern(word);
+            query_terms[i].push_back(id);
+            if (id < terms.size()) {
+                continue;
             }
-            index = i + 1;
-            if (!vec.empty()) {
-                res.push_back(vec);
+            BatchTerm& term = terms.emplace_back();
+            std::vector<QueryTerm> prepared = PrepareQuery(index, word, scorer);
+            if (prepared.empty()) {
+                continue;
             }
-            vec.clear();
+            for (size_t j = 0; j < prepared[0].infos.size(); ++j) {
+                if (!prepared[0].infos[j]) {
+                    continue;
+                }
+                const SegmentedIndex::Segment& segment = index.Segments()[j];
+                segment.index->DecodePostings(*prepared[0].infos[j], postings);
+                for (size_t k = 0; k < postings.lines.size(); ++k) {
+                    uint32_t line = postings.lines[k];
+                    term.lines.push_back(segment.first_line + line);
+                    term.contributions.push_back(
+                        scorer.Score(prepared[0].weight, postings.counts[k], segment.index->GetLineNorm(line)));
+                }
+            }
+        }
+    }
+    size_t candidates = 0;  // postings of all the queries
+    for (size_t i = 0; i < queries.size(); ++i) {
+        for (uint32_t id : query_terms[i]) {
+            candidates += terms[id].lines.size();
+        }
+    }
+    const bool dense = index.LinesCount() <= kDenseLinesPerCandidate * candidates;
+    std::vector<double> scores(dense ? index.LinesCount() : 0);
+    std::vector<size_t> touched;
+    std::vector<std::pair<size_t, double>> contributions;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (with_phrases[i]) {
+            continue;
+        }
+        TopResults top(results_count);
+        if (dense) {
+            for (uint32_t id : query_terms[i]) {
+                const BatchTerm& term = terms[id];
+                for (size_t j = 0; j < term.lines.size(); ++j) {
+                    double& score = scores[term.lines[j]];
+                    if (score == 0) {
+                        touched.push_back(term.lines[j]);
+                    }
+                    score -= term.contributions[j];
+                }
+            }
+            for (size_t line : touched) {
+                // A line is listed twice if a term with zero idf was the first one found in it
+                if (scores[line] != 0) {
+                    top.Add(scores[line], line);
+                    scores[line] = 0;
+                }
+            }
+            touched.clear();
         } else {
-            if (!std::isalpha(text[i])) {
-                if (index != i) {
-                    vec.emplace_back(std::string_view(text.data() + index, i - index));
+            for (uint32_t id : query_terms[i]) {
+                const BatchTerm& term = terms[id];
+                for (size_t j = 0; j < term.lines.size(); ++j) {
+                    contributions.emplace_back(term.lines[j], term.contributions[j]);
+                }
+            }
+            // Stable, so that the contributions to a line are added in the same order as in the dense array
+            std::stable_sort(contributions.begin(), contributions.end(),
+                             [](const auto& left, const auto& right) { return left.first < right.first; });
+            for (size_t j = 0; j < contributions.size();) {
+                size_t line = contributions[j].first;
+                double score = 0;
+                for (; j < contributions.size() && contributions[j].first == line; ++j) {
+                    score -= contributions[j].second;
                 }
-                index = i + 1;
+                top.Add(score, line);
             }
+            contributions.clear();
         }
+        results[i] = top.Extract();
     }
-    if (index != text.size()) {
-        vec.push_back(std::string_view(text.data() + index, text.size() - index));
+    return results;
+}
+
+template <class Scorer>
+BasicSearchEngine<Scorer>::BasicSearchEngine(const SearchOptions& options) : options_(options) {
+    if (options.cache_memory_budget != 0) {
+        cache_ = std::make_unique<ResultCache>(options.cache_memory_budget);
     }
-    if (!vec.empty()) {
-        res.push_back(vec);
+}
+
+template <class Scorer>
+BasicSearchEngine<Scorer>::~BasicSearchEngine() {
+    {
+        std::lock_guard lock(update_mutex_);
+        stopping_ = true;
     }
-    return res;
+    merge_needed_.notify_one();
+    if (merger_.joinable()) {
+        merger_.join();
+    }
+}
+
+template <class Scorer>
+void BasicSearchEngine<Scorer>::Publish(std::vector<std::shared_ptr<const SearchIndex>> segments, bool merged) {
+    if (!merged) {
+        ++generation_;
+    }
+    index_.store(std::make_shared<const SegmentedIndex>(std::move(segments), generation_));
+    // Entries of searches still running on the previous index are tagged with its generation and never returned
+    if (cache_ && !merged) {
+        cache_->Clear();
+    }
+}
+
+template <class Scorer>
+void BasicSearchEngine<Scorer>::BuildIndex(std::string_view text, size_t threads_count) {
+    if (threads_count == 0) {
+        threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    auto index = SearchIndex::Build(text, threads_count, options_.positions);
+    std::lock_guard lock(update_mutex_);
+    Publish({std::move(index)});
+}
+
+template <class Scorer>
+void BasicSearchEngine<Scorer>::BuildIndexFromFile(const std::string& path, size_t threads_count) {
+    if (threads_count == 0) {
+        threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    auto index = SearchIndex::BuildFromFile(path, threads_count, kFileChunkSize, options_.positions);
+    std::lock_guard lock(update_mutex_);
+    Publish({std::move(index)});
 }
 
-double CalculateIdf(const std::vector<std::vector<std::string_view>>& normalized_text, const std::string_view& query) {
-    size_t count = 0;
-    for (size_t i = 0; i < normalized_text.size(); ++i) {
-        bool flag = false;
-        for (const auto& str : normalized_text[i]) {
-            flag |= LowerEqual(str, query);
+template <class Scorer>
+void BasicSearchEngine<Scorer>::AppendText(std::string_view tail) {
+    if (tail.empty()) {
+        return;
+    }
+    auto segment = SearchIndex::Build(tail, 1, options_.positions);
+    std::lock_guard lock(update_mutex_);
+    std::vector<std::shared_ptr<const SearchIndex>> segments;
+    if (auto index = index_.load()) {
+        for (const auto& current : index->Segments()) {
+            segments.push_back(current.index);
         }
-        count += flag;
     }
-    return count == 0 ? 0 : std::log(static_cast<double>(normalized_text.size()) / static_cast<double>(count));
+    segments.push_back(std::move(segment));
+    Publish(std::move(segments));
+    if (!merger_.joinable()) {
+        merger_ = std::thread(&BasicSearchEngine::MergeSegments, this);
+    }
+    merge_needed_.notify_one();
 }
 
-double CalculateTf(const std::vector<std::string_view>& str, const std::string_view& query) {
-    int count_query = 0;
-    for (const auto& s : str) {
-        count_query += LowerEqual(s, query);
+// Runs on the merger thread. Only this thread merges, BuildIndex and LoadIndex replace all the segments, and
+// AppendText only adds new ones at the end, so a merge still applies if the merged segments are still in place.
+template <class Scorer>
+void BasicSearchEngine<Scorer>::MergeSegments() {
+    std::unique_lock lock(update_mutex_);
+    while (true) {
+        std::shared_ptr<const SegmentedIndex> index;
+        size_t merge = 0;
+        merge_needed_.wait(lock, [&] {
+            index = index_.load();
+            return stopping_ || (index && (merge = ChooseMerge(*index)) < index->Segments().size());
+        });
+        if (stopping_) {
+            return;
+        }
+        auto merged_segments = index->Segments().subspan(merge, 2);
+        lock.unlock();
+        const std::shared_ptr<const SearchIndex> parts[] = {merged_segments[0].index, merged_segments[1].index};
+        auto merged = SearchIndex::Merge(parts);
+        lock.lock();
+
+        auto current = index_.load();
+        std::span<const SegmentedIndex::Segment> segments = current->Segments();
+        if (segments.size() < merge + 2 || segments[merge].index != merged_segments[0].index ||
+            segments[merge + 1].index != merged_segments[1].index) {
+            continue;
+        }
+        std::vector<std::shared_ptr<const SearchIndex>> indexes;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (i == merge) {
+                indexes.push_back(merged);
+            } else if (i != merge + 1) {
+                indexes.push_back(segments[i].index);
+            }
+        }
+        Publish(std::move(indexes), true);
     }
-    return str.empty() ? 0 : static_cast<double>(count_query) / static_cast<double>(str.size());
 }
 
-std::vector<std::pair<double, size_t>> CalculateTfIdf(const std::vector<std::vector<std::string_view>>& normalized_text,
-                                                      const std::string_view& query) {
-    std::set<std::string> normalized_query = NormalizeQuery(query);
-    std::vector<std::pair<double, size_t>> results(normalized_text.size());
-    for (size_t i = 0; i < results.size(); ++i) {
-        results[i].first = 0;
-        results[i].second = i;
+template <class Scorer>
+size_t BasicSearchEngine<Scorer>::SegmentsCount() const {
+    std::shared_ptr<const SegmentedIndex> index = index_.load();
+    return index ? index->Segments().size() : 0;
+}
+
+template <class Scorer>
+size_t BasicSearchEngine<Scorer>::IndexMemory() const {
+    std::shared_ptr<const SegmentedIndex> index = index_.load();
+    size_t memory = 0;
+    if (index) {
+        for (const auto& segment : index->Segments()) {
+            memory += segment.index->StorageSize();
+        }
+    }
+    return memory;
+}
+
+template <class Scorer>
+CacheStats BasicSearchEngine<Scorer>::GetCacheStats() const {
+    return cache_ ? cache_->Stats() : CacheStats{};
+}
+
+template <class Scorer>
+void BasicSearchEngine<Scorer>::SaveIndex(const std::string& path) const {
+    std::shared_ptr<const SegmentedIndex> index = index_.load();
+    if (!index) {
+        throw std::logic_error("Nothing to save: BuildIndex was not called");
     }
-    for (const auto& str : normalized_query) {
-        double idf = CalculateIdf(normalized_text, str);
-        for (size_t i = 0; i < normalized_text.size(); ++i) {
-            double tf = CalculateTf(normalized_text[i], str);
-            results[i].first -= idf * tf;
+    std::span<const SegmentedIndex::Segment> segments = index->Segments();
+    if (segments.size() == 1) {
+        segments[0].index->Save(path);
+    } else if (CanMergeSegments(segments)) {
+        std::vector<std::shared_ptr<const SearchIndex>> parts;
+        for (const auto& segment : segments) {
+            parts.push_back(segment.index);
         }
+        SearchIndex::Merge(parts)->Save(path);
+    } else {
+        throw std::logic_error("Cannot save an index of appended texts that are not contiguous in memory");
     }
-    std::sort(results.begin(), results.end());
-    return results;
 }
 
-std::vector<std::string_view> SearchHelp(std::string_view text, std::string_view query, size_t results_count) {
+template <class Scorer>
+void BasicSearchEngine<Scorer>::LoadIndex(const std::string& path, std::string_view text) {
+    auto index = SearchIndex::Load(path, text);
+    std::lock_guard lock(update_mutex_);
+    Publish({std::move(index)});
+}
+
+std::vector<std::string_view> GetLines(const SegmentedIndex& index,
+                                       const std::vector<std::pair<double, size_t>>& top) {
+    std::vector<std::string_view> res;
+    res.reserve(top.size());
+    for (const auto& [score, line] : top) {
+        res.push_back(index.GetLine(line));
+    }
+    return res;
+}
+
+template <class Scorer>
+template <class Trace>
+std::vector<std::string_view> BasicSearchEngine<Scorer>::TracedSearch(std::string_view query, size_t results_count,
+                                                                      Trace& trace) const {
+    trace.Enter(kParsePhase);
+    std::shared_ptr<const SegmentedIndex> index = index_.load();
     std::vector<std::string_view> res;
-    std::vector<std::vector<std::string_view>> normalized_text = NormalizeText(text);
-    std::vector<std::pair<double, size_t>> tf_idf = CalculateTfIdf(normalized_text, query);
-    std::string str;
-    for (size_t i = 0; i < results_count; ++i) {
-        if (i < tf_idf.size() && tf_idf[i].first < 0) {
-            std::pair<size_t, size_t> boundaries = FindStringBoundaries(text, tf_idf[i].second);
-            res.push_back(std::string_view(text.data() + boundaries.first, boundaries.second - boundaries.first));
+    if (!index) {
+        trace.Finish();
+        return res;
+    }
+    std::vector<Phrase> phrases = GetPhrases(*index, query);
+    if (!cache_) {
+        auto top = CalculateResults<Scorer>(*index, query, phrases, results_count, trace);
+        trace.Enter(kSelectPhase);
+        res = GetLines(*index, top);
+        trace.Finish();
+        return res;
+    }
+    std::string key = CacheKey(NormalizeQuery(query), phrases, results_count);
+    std::vector<size_t> lines;
+    if (cache_->Get(key, index->Generation(), lines)) {
+        trace.CountCacheHit();
+    } else {
+        for (const auto& [score, line] : CalculateResults<Scorer>(*index, query, phrases, results_count, trace)) {
+            lines.push_back(line);
         }
+        cache_->Put(std::move(key), index->Generation(), lines);
     }
+    trace.Enter(kSelectPhase);
+    res.reserve(lines.size());
+    for (size_t line : lines) {
+        res.push_back(index->GetLine(line));
+    }
+    trace.Finish();
     return res;
 }
 
-void SearchEngine::BuildIndex(std::string_view text) {
-    text_ = text;
+template <class Scorer>
+std::vector<std::string_view> BasicSearchEngine<Scorer>::Search(std::string_view query,
+                                                                size_t results_count) const {
+    NoTrace trace;
+    return TracedSearch(query, results_count, trace);
+}
+
+template <class Scorer>
+std::vector<std::string_view> BasicSearchEngine<Scorer>::Search(std::string_view query, size_t results_count,
+                                                                QueryTrace& trace) const {
+    return TracedSearch(query, results_count, trace);
+}
+
+template <class Scorer>
+std::vector<std::vector<std::string_view>> BasicSearchEngine<Scorer>::SearchBatch(
+    std::span<const std::string_view> queries, size_t results_count) const {
+    std::vector<std::vector<std::string_view>> res(queries.size());
+    std::shared_ptr<const SegmentedIndex> index = index_.load();
+    if (!index) {
+        return res;
+    }
+    auto tops = CalculateTopBatch<Scorer>(*index, queries, results_count);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        res[i] = GetLines(*index, tops[i]);
+    }
+    return res;
 }
 
-std::vector<std::string_view> SearchEngine::Search(std::string_view query, size_t results_count) const {
-    return SearchHelp(text_, query, results_count);
-}
\ No newline at end of file
+template std::vector<std::pair<double, size_t>> CalculateTop<TfIdfScorer>(const SegmentedIndex&,
+                                                                          const std::string_view&, size_t);
+template std::vector<std::pair<double, size_t>> CalculateTop<Bm25Scorer>(const SegmentedIndex&,
+                                                                         const std::string_view&, size_t);
+template std::vector<std::pair<double, size_t>> CalculateTopPruned<TfIdfScorer>(const SegmentedIndex&,
+                                                                                const std::string_view&, size_t);
+template std::vector<std::pair<double, size_t>> CalculateTopPruned<Bm25Scorer>(const SegmentedIndex&,
+                                                                               const std::string_view&, size_t);
+template std::vector<std::pair<double, size_t>> CalculateTopPhrases<TfIdfScorer>(const SegmentedIndex&,
+                                                                                 const std::string_view&,
+                                                                                 std::span<const Phrase>, size_t);
+template std::vector<std::pair<double, size_t>> CalculateTopPhrases<Bm25Scorer>(const SegmentedIndex&,
+                                                                                const std::string_view&,
+                                                                                std::span<const Phrase>, size_t);
+template class BasicSearchEngine<TfIdfScorer>;
+template class BasicSearchEngine<Bm25Scorer>;
@@ -1,13 +1,111 @@
 #pragma once
 
+#include "cache.h"
+#include "scorer.h"
+#include "segments.h"
+#include "trace.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
-class SearchEngine {
+// Top results_count lines for a query as (negated score, line) pairs, best first, scored by TfIdfScorer or
+// Bm25Scorer. CalculateTop scores every line containing a query term; CalculateTopPruned, used by Search, skips the
+// lines that cannot make it to the top and returns the same results.
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTop(const SegmentedIndex& index, const std::string_view& query,
+                                                    size_t results_count);
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTopPruned(const SegmentedIndex& index, const std::string_view& query,
+                                                          size_t results_count);
+// Same as CalculateTop, keeping only the lines that contain every exact phrase and doubling the scores of the lines
+// where the words of a proximity phrase are close enough. Requires an index with positions.
+template <class Scorer>
+std::vector<std::pair<double, size_t>> CalculateTopPhrases(const SegmentedIndex& index, const std::string_view& query,
+                                                           std::span<const Phrase> phrases, size_t results_count);
+
+struct SearchOptions {
+    size_t cache_memory_budget = 0;  // bytes for the result cache, none if zero
+    bool positions = false;          // store word positions, enabling phrase queries
+};
+
+// BuildIndex tokenizes the text in shards on threads_count threads (all hardware threads by default). The index
+// does not depend on the number of threads.
+//
+// Search may be called concurrently from any number of threads, including concurrently with BuildIndex.
+// BuildIndex prepares a new index aside and then atomically publishes it: searches that already started finish on
+// the previous index (which stays alive until the last of them returns), and subsequent searches see the new one.
+// Searches never wait for indexing to complete. The previous text must stay alive until those searches return.
+//
+// AppendText indexes only the tail of a growing text, as a new segment published the same way. A background thread
+// merges neighbouring segments whose texts follow each other in memory, keeping their number logarithmic; appended
+// texts are referenced, never copied.
+//
+// With positions stored, a query may contain phrases: "new york" only finds lines containing the words in that order
+// and "new york"~2 ranks higher the lines where they are at most two words apart (see ParsePhrases). Without them,
+// quotes are ignored.
+//
+// Lines are ranked by the Scorer policy: SearchEngine uses TF-IDF and Bm25SearchEngine uses BM25.
+//
+// With a nonzero cache budget, results of Search are cached by their normalized queries in an LRU cache taking about
+// that many bytes. Changing the index invalidates the cache; merging segments does not, as results stay the same.
+template <class Scorer>
+class BasicSearchEngine {
 private:
-    std::string_view text_;
+    // Publishes new segments; unless only merged, they get a new generation
+    void Publish(std::vector<std::shared_ptr<const SearchIndex>> segments, bool merged = false);
+    void MergeSegments();
+    template <class Trace>
+    std::vector<std::string_view> TracedSearch(std::string_view query, size_t results_count, Trace& trace) const;
+
+    std::atomic<std::shared_ptr<const SegmentedIndex>> index_;
+    std::mutex update_mutex_;  // serializes publishing new indexes
+    uint64_t generation_ = 0;
+    std::condition_variable merge_needed_;
+    bool stopping_ = false;
+    std::thread merger_;  // started by the first AppendText
+    SearchOptions options_;
+    std::unique_ptr<ResultCache> cache_;
 
 public:
-    void BuildIndex(std::string_view text);
+    explicit BasicSearchEngine(const SearchOptions& options = {});
+    ~BasicSearchEngine();
+
+    void BuildIndex(std::string_view text, size_t threads_count = 0);
+    // Same as BuildIndex with the contents of a file, which is mapped into memory rather than read, so it may be
+    // larger than RAM. Found lines point into the mapping, which stays alive while they may be returned.
+    void BuildIndexFromFile(const std::string& path, size_t threads_count = 0);
+    // Adds lines to the index as if BuildIndex had been called with the text indexed so far followed by the tail.
+    // The tail starts a new line; it must stay alive as long as the rest of the text. Searches see the same results
+    // as with one index of the whole text.
+    void AppendText(std::string_view tail);
+    // Number of segments the index consists of, for monitoring merges
+    size_t SegmentsCount() const;
+    // Bytes taken by all the segments, not counting the text
+    size_t IndexMemory() const;
+    // Hits and misses of the result cache since construction, all zeros without a cache
+    CacheStats GetCacheStats() const;
     std::vector<std::string_view> Search(std::string_view query, size_t results_count) const;
+    // Same as Search, also adding the times of its phases and the work done to the trace. Searches without a trace
+    // are compiled without any tracing code.
+    std::vector<std::string_view> Search(std::string_view query, size_t results_count, QueryTrace& trace) const;
+    // Same as calling Search for every query, but the postings of a term shared by several queries are read once
+    std::vector<std::vector<std::string_view>> SearchBatch(std::span<const std::string_view> queries,
+                                                           size_t results_count) const;
+
+    // Writes the current index to a file. It can be loaded back with LoadIndex as long as the same text is passed.
+    // Segments are merged before saving, which requires the appended tails to be contiguous in memory.
+    void SaveIndex(const std::string& path) const;
+    // Replaces the index with one mapped from a file written by SaveIndex, as BuildIndex(text) would
+    void LoadIndex(const std::string& path, std::string_view text);
 };
+
+using SearchEngine = BasicSearchEngine<TfIdfScorer>;
+using Bm25SearchEngine = BasicSearchEngine<Bm25Scorer>;
@@ -0,0 +1,69 @@
+#include "segments.h"
+
+#include <algorithm>
+
+SegmentedIndex::SegmentedIndex(std::vector<std::shared_ptr<const SearchIndex>> indexes, uint64_t generation)
+    : generation_(generation) {
+    segments_.reserve(indexes.size());
+    for (auto& index : indexes) {
+        size_t lines_count = index->LinesCount();
+        lines_with_words_ += index->LinesWithWords();
+        words_count_ += index->WordsCount();
+        segments_.push_back({std::move(index), lines_count_});
+        lines_count_ += lines_count;
+    }
+}
+
+std::span<const SegmentedIndex::Segment> SegmentedIndex::Segments() const {
+    return segments_;
+}
+
+std::string_view SegmentedIndex::GetLine(size_t line) const {
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), line,
+                               [](size_t line, const Segment& segment) { return line < segment.first_line; });
+    const Segment& segment = *std::prev(it);
+    return segment.index->GetLine(line - segment.first_line);
+}
+
+size_t SegmentedIndex::LinesCount() const {
+    return lines_count_;
+}
+
+size_t SegmentedIndex::LinesWithWords() const {
+    return lines_with_words_;
+}
+
+uint64_t SegmentedIndex::WordsCount() const {
+    return words_count_;
+}
+
+uint64_t SegmentedIndex::Generation() const {
+    return generation_;
+}
+
+bool SegmentedIndex::HasPositions() const {
+    return std::all_of(segments_.begin(), segments_.end(),
+                       [](const Segment& segment) { return segment.index->HasPositions(); });
+}
+
+bool CanMergeSegments(std::span<const SegmentedIndex::Segment> segments) {
+    for (size_t i = 0; i + 1 < segments.size(); ++i) {
+        std::string_view text = segments[i].index->Text();
+        std::string_view next = segments[i + 1].index->Text();
+        if (text.empty() || text.back() != '\n' || text.data() + text.size() != next.data()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t ChooseMerge(const SegmentedIndex& index) {
+    std::span<const SegmentedIndex::Segment> segments = index.Segments();
+    for (size_t i = 0; i + 1 < segments.size(); ++i) {
+        if (segments[i].index->Text().size() <= 2 * segments[i + 1].index->Text().size() &&
+            CanMergeSegments(segments.subspan(i, 2))) {
+            return i;
+        }
+    }
+    return segments.size();
+}
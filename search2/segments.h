@@ -0,0 +1,46 @@
+#pragma once
+
+#include "index.h"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Index of a text made of segments indexing its consecutive parts: the text passed to BuildIndex and the tails
+// appended after it. Every part starts a new line. Lines are numbered through all the segments and term statistics
+// are summed over them, so searching the segments gives the same results as searching one index of the whole text.
+class SegmentedIndex {
+public:
+    struct Segment {
+        std::shared_ptr<const SearchIndex> index;
+        size_t first_line;
+    };
+
+    // Indexes with the same generation give the same search results
+    explicit SegmentedIndex(std::vector<std::shared_ptr<const SearchIndex>> indexes, uint64_t generation = 0);
+
+    std::span<const Segment> Segments() const;
+    std::string_view GetLine(size_t line) const;
+    size_t LinesCount() const;
+    size_t LinesWithWords() const;
+    uint64_t WordsCount() const;
+    uint64_t Generation() const;
+    // Whether all the segments store word positions, so phrases can be matched
+    bool HasPositions() const;
+
+private:
+    std::vector<Segment> segments_;
+    uint64_t generation_;
+    size_t lines_count_ = 0;
+    size_t lines_with_words_ = 0;
+    uint64_t words_count_ = 0;
+};
+
+// Segments can be replaced with one index of their texts, see SearchIndex::Merge, if the texts follow each other in
+// memory and each of them but the last ends with a line break, so that no line changes
+bool CanMergeSegments(std::span<const SegmentedIndex::Segment> segments);
+// First of two neighbouring segments worth merging, or the number of segments if there are none. Segments are merged
+// when the newer one is at least half as large as the older, so their sizes decrease geometrically.
+size_t ChooseMerge(const SegmentedIndex& index);
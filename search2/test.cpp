@@ -1,6 +1,19 @@
 #include <catch.hpp>
 
 #include "search.h"
+#include "codec.h"
+#include "dictionary.h"
+#include "tokenizer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
 
 TEST_CASE("Search") {
     const std::string_view text =
@@ -26,3 +39,584 @@ TEST_CASE("Search") {
 
     REQUIRE(expected == search_engine.Search(query, 1));
 }
+
+TEST_CASE("Search before and after reindexing") {
+    SearchEngine search_engine;
+    REQUIRE(search_engine.Search("lorem", 3).empty());
+
+    const std::string_view first = "Lorem ipsum\ndolor sit amet\n";
+    search_engine.BuildIndex(first);
+    REQUIRE(std::vector<std::string_view>{"dolor sit amet"} == search_engine.Search("DOLOR", 3));
+
+    const std::string_view second = "\n\n12345\nsit, sit, sit!\nlorem sit\n\namet\n";
+    search_engine.BuildIndex(second);
+    const std::vector<std::string_view> expected = {"lorem sit", "sit, sit, sit!"};
+    REQUIRE(expected == search_engine.Search("lorem sit", 5));
+    REQUIRE(search_engine.Search("dolor", 3).empty());
+}
+
+TEST_CASE("Top results keep line order on ties") {
+    const std::string_view text = "cat dog\nbird\ndog cat\ncat\nfish\ncat dog\n";
+    SearchEngine search_engine;
+    search_engine.BuildIndex(text);
+
+    REQUIRE(search_engine.Search("cat", 0).empty());
+    REQUIRE(std::vector<std::string_view>{"cat"} == search_engine.Search("cat", 1));
+    const std::vector<std::string_view> expected = {"cat dog", "dog cat", "cat dog"};
+    REQUIRE(expected == search_engine.Search("dog", 10));
+    REQUIRE(text.data() == search_engine.Search("dog", 1)[0].data());
+}
+
+TEST_CASE("Line boundaries across many lines") {
+    std::string text;
+    for (size_t i = 0; i < 300; ++i) {
+        text += (i % 7 == 0 ? "\n  needle " : "\nhay ") + std::to_string(i) + " hay";
+    }
+    SearchEngine search_engine;
+    search_engine.BuildIndex(text);
+
+    auto result = search_engine.Search("needle", 100);
+    REQUIRE(result.size() == 43);
+    for (size_t i = 0; i < result.size(); ++i) {
+        REQUIRE(result[i] == "  needle " + std::to_string(i * 7) + " hay");
+        REQUIRE(result[i].data() >= text.data());
+        REQUIRE(result[i].data() + result[i].size() <= text.data() + text.size());
+    }
+}
+
+TEST_CASE("Concurrent search during reindexing") {
+    const std::string_view first = "alpha beta\ngamma\ndelta\n";
+    const std::string_view second = "gamma\nbeta alpha\nepsilon\nzeta\n";
+    SearchEngine search_engine;
+    search_engine.BuildIndex(first);
+
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> unexpected = 0;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                auto result = search_engine.Search("alpha", 1);
+                if (result.size() != 1 || (result[0].data() != first.data() && result[0].data() != second.data() + 6)) {
+                    ++unexpected;
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < 200; ++i) {
+        search_engine.BuildIndex(i % 2 == 0 ? second : first);
+    }
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(unexpected == 0);
+}
+
+TEST_CASE("Sharded index matches a single-threaded one") {
+    std::string text;
+    const std::vector<std::string> words = {"lorem", "Ipsum", "dolor", "sit", "amet", "x", "a", "b", "c"};
+    for (size_t i = 0; text.size() < (1 << 20); ++i) {
+        text += words[i % 9] + (i % 5 == 0 ? "\n" : ", ") + words[i * i % 7];
+        text += i % 11 == 0 ? "\n\n" : (i % 3 == 0 ? "\n" : " ");
+    }
+    SearchEngine serial;
+    serial.BuildIndex(text, 1);
+    for (size_t threads_count : {2, 3, 8}) {
+        SearchEngine sharded;
+        sharded.BuildIndex(text, threads_count);
+        for (const auto& query : {"lorem", "ipsum sit", "x a b c", "amet dolor lorem", "zzz"}) {
+            REQUIRE(serial.Search(query, 50) == sharded.Search(query, 50));
+        }
+    }
+
+    // The first shards have lines but no words
+    std::string numbers;
+    while (numbers.size() < (3 << 20)) {
+        numbers += "12345 67890 000\n";
+    }
+    text = numbers + "alpha beta\n" + text + numbers;
+    serial.BuildIndex(text, 1);
+    REQUIRE(serial.Search("alpha", 1) == std::vector<std::string_view>{"alpha beta"});
+    for (size_t threads_count : {2, 3, 8}) {
+        SearchEngine sharded;
+        sharded.BuildIndex(text, threads_count);
+        for (const auto& query : {"alpha", "lorem", "ipsum sit", "x a b c", "amet dolor lorem"}) {
+            REQUIRE(serial.Search(query, 50) == sharded.Search(query, 50));
+        }
+    }
+}
+
+TEST_CASE("Batch search matches single searches") {
+    const std::string_view text =
+        "the quick brown fox\n"
+        "jumps over the lazy dog\n"
+        "The dog barks\n"
+        "a quick brown dog\n"
+        "foxes and dogs\n";
+    SearchEngine search_engine;
+    const std::vector<std::string_view> queries = {"quick dog", "the fox", "", "DOG", "cat", "brown the quick"};
+    REQUIRE(search_engine.SearchBatch(queries, 3) == std::vector<std::vector<std::string_view>>(queries.size()));
+
+    search_engine.BuildIndex(text);
+    auto batch = search_engine.SearchBatch(queries, 3);
+    REQUIRE(batch.size() == queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(batch[i] == search_engine.Search(queries[i], 3));
+    }
+    REQUIRE(search_engine.SearchBatch({}, 3).empty());
+
+    // Few postings in a large index, which are summed without the dense array of scores
+    std::string large(text);
+    for (size_t i = 0; i < 10000; ++i) {
+        large += i % 1000 == 0 ? "a lazy fox\n" : "filler words only\n";
+    }
+    search_engine.BuildIndex(large);
+    batch = search_engine.SearchBatch(queries, 3);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(batch[i] == search_engine.Search(queries[i], 3));
+    }
+}
+
+TEST_CASE("Pruned scoring matches exhaustive scoring") {
+    std::mt19937 rng(3);
+    auto word = [&rng] { return std::string(1 + rng() % 3, static_cast<char>('a' + rng() % 5)); };
+    std::string text;
+    for (size_t line = 0; line < 3000; ++line) {
+        for (size_t i = rng() % 40; i > 0; --i) {
+            text += (line % 100 == 0 ? "rare " : "") + word() + " ";
+        }
+        text += "\n";
+    }
+    SegmentedIndex index({SearchIndex::Build(text, 1)});
+    // The same text split into segments at line breaks
+    std::vector<std::shared_ptr<const SearchIndex>> parts;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = text.find('\n', std::min(text.size() - 1, begin + rng() % 20000)) + 1;
+        parts.push_back(SearchIndex::Build(std::string_view(text).substr(begin, end - begin), 1));
+        begin = end;
+    }
+    SegmentedIndex segmented(parts);
+    REQUIRE(segmented.Segments().size() > 3);
+    for (size_t iteration = 0; iteration < 300; ++iteration) {
+        std::string query = iteration % 3 == 0 ? "rare" : "";
+        for (size_t i = rng() % 15; i > 0; --i) {
+            query += " " + word();
+        }
+        for (size_t results_count : {1, 3, 10, 100, 10000}) {
+            auto expected = CalculateTop<TfIdfScorer>(index, query, results_count);
+            REQUIRE(expected == CalculateTopPruned<TfIdfScorer>(index, query, results_count));
+            REQUIRE(expected == CalculateTop<TfIdfScorer>(segmented, query, results_count));
+            REQUIRE(expected == CalculateTopPruned<TfIdfScorer>(segmented, query, results_count));
+            auto expected_bm25 = CalculateTop<Bm25Scorer>(index, query, results_count);
+            REQUIRE(expected_bm25 == CalculateTopPruned<Bm25Scorer>(index, query, results_count));
+            REQUIRE(expected_bm25 == CalculateTopPruned<Bm25Scorer>(segmented, query, results_count));
+        }
+    }
+}
+
+TEST_CASE("BM25 ranking") {
+    SearchEngine tf_idf;
+    Bm25SearchEngine bm25;
+    tf_idf.BuildIndex("banana\nbanana banana banana banana\ncherry\n");
+    bm25.BuildIndex("banana\nbanana banana banana banana\ncherry\n");
+    // Both lines consist of the term, but BM25 counts its occurrences rather than its share of the line
+    REQUIRE(tf_idf.Search("banana", 10) == std::vector<std::string_view>{"banana", "banana banana banana banana"});
+    REQUIRE(bm25.Search("banana", 10) == std::vector<std::string_view>{"banana banana banana banana", "banana"});
+    REQUIRE(bm25.SearchBatch(std::vector<std::string_view>{"banana"}, 10)[0] == bm25.Search("banana", 10));
+
+    // A term of every line still counts, more in shorter lines
+    tf_idf.BuildIndex("apple banana\napple\n");
+    bm25.BuildIndex("apple banana\napple\n");
+    REQUIRE(tf_idf.Search("apple", 10).empty());
+    REQUIRE(bm25.Search("apple", 10) == std::vector<std::string_view>{"apple", "apple banana"});
+
+    Bm25Scorer scorer(4, 8);
+    REQUIRE(scorer.Weight(4) > 0);
+    REQUIRE(scorer.Score(1, 2, 2) > scorer.Score(1, 1, 2));
+    REQUIRE(scorer.Score(1, 2, 2) < 2 * scorer.Score(1, 1, 2));
+    REQUIRE(scorer.Score(1, 1, 1) > scorer.Score(1, 1, 2));
+    REQUIRE(scorer.Bound(1, 0.5) >= scorer.Score(1, 1, 2));
+    REQUIRE(scorer.Bound(1, 0.5) >= scorer.Score(1, 100, 200));
+}
+
+TEST_CASE("Appended text is searched as one index") {
+    std::string text;
+    for (size_t i = 0; i < 2000; ++i) {
+        text += (i % 3 == 0 ? "error disk " : "info ") + std::to_string(i) + (i % 7 == 0 ? " disk full\n" : "\n");
+    }
+    const std::vector<std::string_view> queries = {"error", "disk full", "info error", "full"};
+    SearchEngine whole;
+    whole.BuildIndex(text);
+    SearchEngine appended;
+    REQUIRE(appended.SegmentsCount() == 0);
+    appended.AppendText(std::string_view(text).substr(0, 100));
+    for (size_t begin = 100; begin < text.size();) {
+        size_t end = std::min(text.find('\n', begin + 500), text.size() - 1) + 1;
+        appended.AppendText(std::string_view(text).substr(begin, end - begin));
+        begin = end;
+    }
+    for (auto query : queries) {
+        REQUIRE(appended.Search(query, 20) == whole.Search(query, 20));
+    }
+    REQUIRE(appended.SearchBatch(queries, 20) == whole.SearchBatch(queries, 20));
+
+    // Tails are contiguous in memory, so the background thread merges them
+    for (size_t i = 0; i < 1000 && appended.SegmentsCount() > 8; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(appended.SegmentsCount() <= 8);
+    for (auto query : queries) {
+        REQUIRE(appended.Search(query, 20) == whole.Search(query, 20));
+    }
+
+    // Tails in separate buffers are searched as separate segments
+    const std::string first = "alpha beta\ngamma\n";
+    const std::string second = "beta\ndelta alpha alpha";
+    SearchEngine separate;
+    separate.BuildIndex(first);
+    separate.AppendText(second);
+    separate.AppendText("");
+    REQUIRE(separate.SegmentsCount() == 2);
+    REQUIRE(separate.Search("alpha", 3) == std::vector<std::string_view>{"delta alpha alpha", "alpha beta"});
+    REQUIRE(separate.Search("alpha", 1)[0].data() == second.data() + 5);
+    REQUIRE_THROWS(separate.SaveIndex((std::filesystem::temp_directory_path() / "test_search2_segments.bin").string()));
+}
+
+TEST_CASE("Result cache") {
+    const std::string_view first = "alpha beta\nbeta gamma\ngamma delta\n";
+    const std::string_view second = "gamma alpha\nbeta\n";
+    SearchEngine search_engine({.cache_memory_budget = 1 << 20});
+    SearchEngine uncached;
+    search_engine.BuildIndex(first);
+    uncached.BuildIndex(first);
+    REQUIRE(search_engine.Search("beta gamma", 2) == uncached.Search("beta gamma", 2));
+    REQUIRE(search_engine.Search("Gamma BETA beta", 2) == uncached.Search("beta gamma", 2));
+    REQUIRE(search_engine.Search("beta gamma", 1) == uncached.Search("beta gamma", 1));
+    CacheStats stats = search_engine.GetCacheStats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.entries == 2);
+
+    search_engine.BuildIndex(second);
+    uncached.BuildIndex(second);
+    REQUIRE(search_engine.GetCacheStats().entries == 0);
+    REQUIRE(search_engine.Search("beta gamma", 2) == uncached.Search("beta gamma", 2));
+    REQUIRE(search_engine.GetCacheStats().misses == 3);
+    REQUIRE(uncached.GetCacheStats().hits == 0);
+
+    ResultCache cache(16 * 1024);
+    for (size_t i = 0; i < 1000; ++i) {
+        cache.Put(std::to_string(i), 0, std::vector<size_t>(i % 10));
+    }
+    REQUIRE(cache.Stats().memory <= 16 * 1024);
+    std::vector<size_t> lines;
+    REQUIRE(cache.Get("999", 0, lines));
+    REQUIRE(lines.size() == 9);
+    REQUIRE_FALSE(cache.Get("999", 1, lines));
+    REQUIRE_FALSE(cache.Get("0", 0, lines));
+}
+
+TEST_CASE("Query trace") {
+    std::string text;
+    for (size_t i = 0; i < 1000; ++i) {
+        text += (i % 3 == 0 ? "alpha " : "beta ") + std::string(i % 5 == 0 ? "gamma" : "delta") + "\n";
+    }
+    SearchEngine untraced;
+    SearchEngine cached({.cache_memory_budget = 1 << 20, .positions = true});
+    untraced.BuildIndex(text);
+    cached.BuildIndex(text);
+
+    for (const auto& query : {"alpha gamma", "delta", "\"alpha gamma\""}) {
+        QueryTrace trace;
+        auto found = cached.Search(query, 10, trace);
+        REQUIRE(found == untraced.Search(query, 10));
+        REQUIRE_FALSE(trace.cache_hit);
+        REQUIRE(trace.postings_scanned >= trace.lines_scored);
+        REQUIRE(trace.blocks_decoded > 0);
+        REQUIRE(trace.bytes_decoded >= trace.blocks_decoded);
+        REQUIRE(trace.lines_scored >= 10);
+        REQUIRE(trace.times[kScorePhase].count() > 0);
+
+        QueryTrace hit;
+        REQUIRE(cached.Search(query, 10, hit) == found);
+        REQUIRE(hit.cache_hit);
+        REQUIRE(hit.postings_scanned == 0);
+        REQUIRE(hit.times[kScorePhase].count() == 0);
+    }
+    // Most lines of the frequent term are skipped once the top is full of better ones
+    QueryTrace pruned;
+    REQUIRE(untraced.Search("alpha delta", 10, pruned) == untraced.Search("alpha delta", 10));
+    REQUIRE(pruned.lines_scored < 1000);
+    REQUIRE(pruned.lines_scored + pruned.lines_pruned <= 1000);
+}
+
+TEST_CASE("Saved index is loaded back") {
+    const std::string_view text = "alpha beta\n\ngamma alpha\ndelta\nbeta beta beta\n";
+    const std::string path = (std::filesystem::temp_directory_path() / "test_search2_index.bin").string();
+    SearchEngine built;
+    REQUIRE_THROWS(built.SaveIndex(path));
+    built.BuildIndex(text);
+    built.SaveIndex(path);
+
+    SearchEngine loaded;
+    loaded.LoadIndex(path, text);
+    for (const auto& query : {"alpha", "beta gamma", "delta alpha beta", "epsilon"}) {
+        REQUIRE(built.Search(query, 10) == loaded.Search(query, 10));
+    }
+    REQUIRE(loaded.Search("delta", 1)[0].data() == text.data() + 24);
+    REQUIRE(loaded.IndexMemory() == built.IndexMemory());
+
+    const std::string_view other_text = "alpha beta\n\ngamma alpha\ndelta\nbeta beta gamma\n";
+    REQUIRE_THROWS(loaded.LoadIndex(path, other_text));
+    REQUIRE_THROWS(loaded.LoadIndex(path + ".missing", text));
+    REQUIRE(loaded.Search("delta", 1)[0].data() == text.data() + 24);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Phrase queries") {
+    const std::string_view text =
+        "new york city\nyork new\nnew big york\nnew\nthe new york times new york\nalpha\nbeta\ngamma\n";
+    auto lines = [](std::initializer_list<size_t> numbers) {
+        const std::vector<std::string_view> all = {"new york city", "york new", "new big york", "new",
+                                                   "the new york times new york"};
+        std::vector<std::string_view> res;
+        for (size_t number : numbers) {
+            res.push_back(all[number]);
+        }
+        return res;
+    };
+    SearchEngine plain;
+    SearchEngine positional({.cache_memory_budget = 1 << 20, .positions = true});
+    plain.BuildIndex(text);
+    positional.BuildIndex(text);
+    REQUIRE(plain.Search("\"new york\"", 10) == plain.Search("new york", 10));
+    REQUIRE(positional.Search("new york", 10) == plain.Search("new york", 10));
+    REQUIRE(positional.Search("\"new york\"", 10) == lines({0, 4}));
+    REQUIRE(positional.Search("\"New York\" city", 10) == lines({0, 4}));
+    REQUIRE(positional.Search("\"york new york\"", 10).empty());
+    REQUIRE(positional.Search("\"york\"", 10) == plain.Search("york", 10));
+    REQUIRE(positional.Search("new york", 10) == lines({1, 3, 0, 2, 4}));
+    REQUIRE(positional.Search("\"new york\"~1", 10) == lines({0, 2, 4, 1, 3}));
+    REQUIRE(positional.Search("\"new york\"~0", 10) == lines({0, 4, 1, 3, 2}));
+    REQUIRE(positional.SearchBatch(std::vector<std::string_view>{"\"new york\"", "new york"}, 10) ==
+            std::vector{lines({0, 4}), lines({1, 3, 0, 2, 4})});
+
+    const std::string path = (std::filesystem::temp_directory_path() / "test_search2_positions.bin").string();
+    positional.SaveIndex(path);
+    SearchEngine loaded;
+    loaded.LoadIndex(path, text);
+    REQUIRE(loaded.Search("\"new york\"", 10) == lines({0, 4}));
+    std::remove(path.c_str());
+
+    SearchEngine appended({.positions = true});
+    appended.BuildIndex(text.substr(0, 14));
+    appended.AppendText(text.substr(14));
+    REQUIRE(appended.Search("\"new york\"~1", 10) == lines({0, 2, 4, 1, 3}));
+
+    std::vector<Phrase> phrases = ParsePhrases("a \"b  c\"~3 \"d\" e \"f");
+    REQUIRE(phrases.size() == 2);
+    REQUIRE(phrases[0].words == std::vector<std::string_view>{"b", "c"});
+    REQUIRE(phrases[0].slop == 3);
+    REQUIRE(phrases[1].words == std::vector<std::string_view>{"d"});
+    REQUIRE_FALSE(phrases[1].slop);
+    const std::vector<uint32_t> values = {1, 3, 5, 7, 9};
+    REQUIRE(Gallop(values, 0, 6) == 3);
+    REQUIRE(Gallop(values, 2, 1) == 2);
+    REQUIRE(Gallop(values, 1, 10) == 5);
+}
+
+TEST_CASE("Index built from a file") {
+    std::string text;
+    for (size_t i = 0; i < 3000; ++i) {
+        text += std::string(i % 50, 'x') + (i % 4 == 0 ? " needle " : " hay ") + std::to_string(i) + "\n";
+    }
+    text += "last needle line";
+    const std::string path = (std::filesystem::temp_directory_path() / "test_search2_text.txt").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << text;
+    }
+    auto saved = [](const SearchIndex& index) {
+        const std::string saved_path = (std::filesystem::temp_directory_path() / "test_search2_saved.bin").string();
+        index.Save(saved_path);
+        std::ifstream file(saved_path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::remove(saved_path.c_str());
+        return bytes;
+    };
+    for (bool with_positions : {false, true}) {
+        // Chunks are encoded and merged as they are indexed, into the very index of the whole text
+        const std::string whole = saved(*SearchIndex::Build(text, 1, with_positions));
+        for (size_t chunk_size : {100, 1000, 4096, 1 << 20}) {
+            REQUIRE(saved(*SearchIndex::BuildFromFile(path, 2, chunk_size, with_positions)) == whole);
+        }
+    }
+    for (size_t chunk_size : {100, 4096, 1 << 20}) {
+        SegmentedIndex from_file({SearchIndex::BuildFromFile(path, 2, chunk_size)});
+        SegmentedIndex from_text({SearchIndex::Build(text, 1)});
+        REQUIRE(from_file.LinesCount() == from_text.LinesCount());
+        for (const auto& query : {"needle", "hay xxx", "line"}) {
+            auto top = CalculateTopPruned<TfIdfScorer>(from_file, query, 100);
+            REQUIRE(top == CalculateTopPruned<TfIdfScorer>(from_text, query, 100));
+            for (const auto& [score, line] : top) {
+                REQUIRE(from_file.GetLine(line) == from_text.GetLine(line));
+            }
+        }
+    }
+
+    SearchEngine search_engine;
+    search_engine.BuildIndexFromFile(path);
+    std::remove(path.c_str());
+    auto result = search_engine.Search("last", 1);
+    REQUIRE(result == std::vector<std::string_view>{"last needle line"});
+    REQUIRE(result[0].data() != text.data() + text.size() - result[0].size());
+    REQUIRE_THROWS(search_engine.BuildIndexFromFile(path));
+}
+
+TEST_CASE("Stream VByte round trip") {
+    std::mt19937 rng(42);
+    for (size_t count : {0, 1, 3, 4, 5, 127, 128, 1000}) {
+        std::vector<uint32_t> values(count);
+        uint32_t line = 0;
+        for (auto& value : values) {
+            line += rng() >> (rng() % 32);  // differences of every byte length
+            value = line;
+        }
+        for (bool delta : {true, false}) {
+            uint32_t base = delta && count > 0 ? values[0] / 2 : 0;
+            std::vector<uint8_t> encoded(StreamVByteSize(values.data(), count, base, delta) + kStreamVByteTail);
+            size_t size = EncodeStreamVByte(values.data(), count, base, delta, encoded.data());
+            REQUIRE(size + kStreamVByteTail == encoded.size());
+
+            std::vector<uint32_t> scalar(count);
+            std::vector<uint32_t> simd(count);
+            REQUIRE(DecodeStreamVByteScalar(encoded.data(), count, base, delta, scalar.data()) == size);
+            REQUIRE(DecodeStreamVByte(encoded.data(), count, base, delta, simd.data()) == size);
+            REQUIRE(scalar == values);
+            REQUIRE(simd == values);
+        }
+    }
+}
+
+TEST_CASE("Term dictionary interns words in any case") {
+    TermDictionary dictionary;
+    REQUIRE(dictionary.Find("word") == kNoTerm);
+    REQUIRE(dictionary.Intern("Word") == 0);
+    REQUIRE(dictionary.Intern("other") == 1);
+    REQUIRE(dictionary.Intern("WORD") == 0);
+    REQUIRE(dictionary.GetTerm(0) == "word");
+    for (size_t i = 0; i < 26 * 26; ++i) {
+        std::string word = {'t', 'e', 'r', 'm', static_cast<char>('a' + i % 26), static_cast<char>('a' + i / 26)};
+        REQUIRE(dictionary.Intern(word) == i + 2);
+    }
+    REQUIRE(dictionary.Size() == 26 * 26 + 2);
+    REQUIRE(dictionary.Find("TERMBB") == 29);
+    REQUIRE(dictionary.Find("term") == kNoTerm);
+    REQUIRE(HashWord("MixedCaseLongWord") == HashWord("mixedcaselongword"));
+
+    SearchEngine search_engine;
+    search_engine.BuildIndex("Alpha beta\nALPHA\ngamma\n");
+    REQUIRE(search_engine.Search("aLpHa", 5) == std::vector<std::string_view>{"ALPHA", "Alpha beta"});
+}
+
+// Tokenization of the text before the index was introduced
+std::vector<std::vector<std::string_view>> NormalizeText(const std::string_view& text) {
+    size_t index = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\n') {
+            index = i;
+            break;
+        }
+    }
+    std::vector<std::vector<std::string_view>> res;
+    std::vector<std::string_view> vec;
+    for (size_t i = index; i < text.size(); ++i) {
+        if (text[i] == '\n') {
+            if (index != i) {
+                vec.emplace_back(std::string_view(text.data() + index, i - index));
+            }
+            index = i + 1;
+            if (!vec.empty()) {
+                res.push_back(vec);
+            }
+            vec.clear();
+        } else {
+            if (!std::isalpha(static_cast<unsigned char>(text[i]))) {
+                if (index != i) {
+                    vec.emplace_back(std::string_view(text.data() + index, i - index));
+                }
+                index = i + 1;
+            }
+        }
+    }
+    if (index != text.size()) {
+        vec.push_back(std::string_view(text.data() + index, text.size() - index));
+    }
+    if (!vec.empty()) {
+        res.push_back(vec);
+    }
+    return res;
+}
+
+TEST_CASE("Tokenizer matches NormalizeText") {
+    std::mt19937 rng(7);
+    const std::string alphabet = "aZq\n\n ,.-09@[`{\t";
+    for (size_t iteration = 0; iteration < 2000; ++iteration) {
+        std::string text(rng() % 300, ' ');
+        for (auto& c : text) {
+            c = rng() % 4 == 0 ? static_cast<char>(rng() % 255 + 1) : alphabet[rng() % alphabet.size()];
+        }
+        std::vector<std::vector<std::string_view>> lines;
+        std::vector<std::string_view> line;
+        auto on_word = [&](size_t begin, size_t end) {
+            line.push_back(std::string_view(text).substr(begin, end - begin));
+        };
+        auto on_newline = [&](size_t) {
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+            line.clear();
+        };
+        Tokenize(text, on_word, on_newline);
+        on_newline(text.size());
+        REQUIRE(lines == NormalizeText(text));
+    }
+}
+
+TEST_CASE("SIMD block classifiers match the scalar one") {
+    std::vector<BlockMasks (*)(const char*)> classifiers = {ClassifyBlock};
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2")) {
+        classifiers.push_back(ClassifyBlockSse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        classifiers.push_back(ClassifyBlockAvx2);
+    }
+#endif
+    std::mt19937 rng(7);
+    std::vector<std::string> blocks;
+    // Every byte value, then random bytes
+    for (size_t first = 0; first < 256; first += kTokenizerBlockSize) {
+        std::string block(kTokenizerBlockSize, ' ');
+        for (size_t i = 0; i < kTokenizerBlockSize; ++i) {
+            block[i] = static_cast<char>(first + i);
+        }
+        blocks.push_back(block);
+    }
+    for (size_t iteration = 0; iteration < 2000; ++iteration) {
+        std::string block(kTokenizerBlockSize, ' ');
+        for (auto& c : block) {
+            c = static_cast<char>(rng());
+        }
+        blocks.push_back(block);
+    }
+    for (const auto& block : blocks) {
+        BlockMasks scalar = ClassifyBlockScalar(block.data());
+        for (auto classifier : classifiers) {
+            BlockMasks simd = classifier(block.data());
+            REQUIRE(simd.letters == scalar.letters);
+            REQUIRE(simd.newlines == scalar.newlines);
+        }
+    }
+}
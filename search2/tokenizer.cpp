@@ -0,0 +1,84 @@
+#include "tokenizer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86
+#endif
+
+bool IsLetter(char c) {
+    return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+}
+
+BlockMasks ClassifyBlockScalar(const char* block) {
+    BlockMasks masks = {0, 0};
+    for (size_t i = 0; i < kTokenizerBlockSize; ++i) {
+        masks.letters |= static_cast<uint64_t>(IsLetter(block[i])) << i;
+        masks.newlines |= static_cast<uint64_t>(block[i] == '\n') << i;
+    }
+    return masks;
+}
+
+#ifdef TOKENIZER_X86
+// A byte is a letter if, with the case bit set, it lies in ['a', 'z']. Shifting that range to the bottom of the
+// signed bytes turns the check into a single signed comparison.
+__attribute__((target("sse2"))) BlockMasks ClassifyBlockSse2(const char* block) {
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(-128 - 'a'));
+    const __m128i letters_end = _mm_set1_epi8(-128 + 26);
+    const __m128i newline = _mm_set1_epi8('\n');
+    BlockMasks masks = {0, 0};
+    for (size_t i = 0; i < kTokenizerBlockSize; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        __m128i shifted = _mm_add_epi8(_mm_or_si128(bytes, case_bit), shift);
+        uint64_t letters = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmplt_epi8(shifted, letters_end)));
+        uint64_t newlines = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+        masks.letters |= letters << i;
+        masks.newlines |= newlines << i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) BlockMasks ClassifyBlockAvx2(const char* block) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(-128 - 'a'));
+    const __m256i letters_end = _mm256_set1_epi8(-128 + 26);
+    const __m256i newline = _mm256_set1_epi8('\n');
+    BlockMasks masks = {0, 0};
+    for (size_t i = 0; i < kTokenizerBlockSize; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        __m256i shifted = _mm256_add_epi8(_mm256_or_si256(bytes, case_bit), shift);
+        uint64_t letters = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(letters_end, shifted)));
+        uint64_t newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)));
+        masks.letters |= letters << i;
+        masks.newlines |= newlines << i;
+    }
+    return masks;
+}
+#endif
+
+using BlockClassifier = BlockMasks (*)(const char*);
+
+BlockClassifier ChooseBlockClassifier() {
+#ifdef TOKENIZER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return ClassifyBlockAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return ClassifyBlockSse2;
+    }
+#endif
+    return ClassifyBlockScalar;
+}
+
+BlockMasks ClassifyBlock(const char* block) {
+    static const BlockClassifier kClassifier = ChooseBlockClassifier();
+    return kClassifier(block);
+}
+
+void AppendFoldedWord(std::string_view word, std::string& out) {
+    size_t size = out.size();
+    out.resize(size + word.size());
+    for (size_t i = 0; i < word.size(); ++i) {
+        out[size + i] = static_cast<char>(word[i] | 0x20);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Words are maximal runs of ASCII letters, the same characters std::isalpha accepts in the "C" locale.
+// The text is classified 64 bytes at a time into bit masks, and the boundaries of words are found with bit
+// operations on the masks instead of a branch per character.
+
+const size_t kTokenizerBlockSize = 64;
+
+// Bit i is set if the i-th byte of the block is a letter or a line break respectively
+struct BlockMasks {
+    uint64_t letters;
+    uint64_t newlines;
+};
+
+// Uses AVX2 or SSE2 when the processor supports them
+BlockMasks ClassifyBlock(const char* block);
+BlockMasks ClassifyBlockScalar(const char* block);
+#if defined(__x86_64__) || defined(__i386__)
+// Only for processors supporting the instructions, as ClassifyBlock checks
+BlockMasks ClassifyBlockSse2(const char* block);
+BlockMasks ClassifyBlockAvx2(const char* block);
+#endif
+
+// Appends the lowercase form of a word
+void AppendFoldedWord(std::string_view word, std::string& out);
+
+// Calls on_word(begin, end) for every word and on_newline(position) for every '\n' of the text, in text order
+template <class OnWord, class OnNewline>
+void Tokenize(std::string_view text, OnWord&& on_word, OnNewline&& on_newline) {
+    size_t word_begin = 0;
+    uint64_t previous_letter = 0;  // whether the last byte of the previous block is a letter
+    for (size_t block = 0; block < text.size(); block += kTokenizerBlockSize) {
+        BlockMasks masks;
+        if (text.size() - block >= kTokenizerBlockSize) {
+            masks = ClassifyBlock(text.data() + block);
+        } else {
+            char tail[kTokenizerBlockSize] = {};
+            std::memcpy(tail, text.data() + block, text.size() - block);
+            masks = ClassifyBlock(tail);
+        }
+        uint64_t shifted = (masks.letters << 1) | previous_letter;
+        uint64_t starts = masks.letters & ~shifted;
+        uint64_t ends = ~masks.letters & shifted;
+        previous_letter = masks.letters >> (kTokenizerBlockSize - 1);
+        for (uint64_t events = starts | ends | masks.newlines; events != 0; events &= events - 1) {
+            size_t bit = std::countr_zero(events);
+            uint64_t mask = uint64_t{1} << bit;
+            if (starts & mask) {
+                word_begin = block + bit;
+                continue;
+            }
+            if (ends & mask) {
+                on_word(word_begin, block + bit);
+            }
+            if (masks.newlines & mask) {
+                on_newline(block + bit);
+            }
+        }
+    }
+    if (previous_letter) {
+        on_word(word_begin, text.size());
+    }
+}
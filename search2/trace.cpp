@@ -0,0 +1,30 @@
+#include "trace.h"
+
+void QueryTrace::Enter(TracePhase phase) {
+    auto now = std::chrono::steady_clock::now();
+    if (phase_ != kPhasesCount) {
+        times[phase_] += now - phase_start_;
+    }
+    phase_ = phase;
+    phase_start_ = now;
+}
+
+void QueryTrace::Finish() {
+    Enter(kPhasesCount);
+}
+
+void QueryTrace::CountBlocks(const SearchIndex& index, std::span<const PostingsBlock> blocks) {
+    for (const PostingsBlock& block : blocks) {
+        postings_scanned += block.count;
+    }
+    blocks_decoded += blocks.size();
+    bytes_decoded += index.BlocksSize(blocks);
+}
+
+void QueryTrace::CountLine(bool pruned) {
+    ++(pruned ? lines_pruned : lines_scored);
+}
+
+void QueryTrace::CountCacheHit() {
+    cache_hit = true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "index.h"
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+
+enum TracePhase {
+    kParsePhase,   // tokenizing the query, looking up its terms and the cache
+    kScorePhase,   // traversing postings and scoring lines, which are interleaved
+    kSelectPhase,  // extracting the top lines
+    kPhasesCount
+};
+
+// Where the time of one query went, filled by SearchEngine::Search when passed one
+struct QueryTrace {
+    static constexpr bool kEnabled = true;
+
+    std::chrono::nanoseconds times[kPhasesCount] = {};
+    uint64_t postings_scanned = 0;  // decoded postings
+    uint64_t blocks_decoded = 0;
+    uint64_t bytes_decoded = 0;  // encoded sizes of the decoded blocks
+    uint64_t lines_scored = 0;   // candidate lines whose scores were computed
+    uint64_t lines_pruned = 0;   // candidate lines abandoned as soon as they could not make it to the top
+    bool cache_hit = false;
+
+    // Ends the current phase, if any, and starts the given one
+    void Enter(TracePhase phase);
+    void Finish();
+    void CountBlocks(const SearchIndex& index, std::span<const PostingsBlock> blocks);
+    void CountLine(bool pruned);
+    void CountCacheHit();
+
+private:
+    TracePhase phase_ = kPhasesCount;
+    std::chrono::steady_clock::time_point phase_start_;
+};
+
+// Tracer of the queries that are not traced. Its calls are empty and inlined, and the code computing their arguments
+// is guarded by kEnabled, so untraced searches cost the same as without tracing at all.
+struct NoTrace {
+    static constexpr bool kEnabled = false;
+
+    void Enter(TracePhase) {
+    }
+    void Finish() {
+    }
+    void CountBlocks(const SearchIndex&, std::span<const PostingsBlock>) {
+    }
+    void CountLine(bool) {
+    }
+    void CountCacheHit() {
+    }
+};